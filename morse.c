@@ -1,18 +1,25 @@
 #include "morse.h"
+#include "morse_glyphs.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
 
+#if MORSE_STDIO || defined(MORSE_MAIN)
+  #include <stdio.h>
+#endif  // MORSE_STDIO
 #ifdef MORSE_MAIN
   #include <unistd.h>
 #endif  // MORSE_MAIN
 
-#define OFFSET 48
-#define MAX_CHAR 'Z'
+#if MORSE_STDIO
+  #define MORSE_REPORT(...) fprintf(stderr, __VA_ARGS__)
+#else
+  #define MORSE_REPORT(...) ((void) 0)
+#endif  // MORSE_STDIO
 
 
 // --------------------------------------------------------------------
@@ -20,78 +27,282 @@
 
 void (*morse_cb)(bool value);
 
-static uint8_t morse_buf1[MORSE_MAX_LEN];
-static uint8_t morse_buf2[MORSE_MAX_LEN];
-static uint8_t *morse_live_buf = morse_buf1;
-static uint8_t *morse_next_buf = morse_buf2;
-static bool morse_repeat = false;
-static bool morse_repeat_next = false;
-static uint32_t morse_dot_duration = 120;  // ms  ~= 10wpm
-static uint32_t morse_elapsed_time = 0;  // time since message start.
-
-static char *letters[] = {
-              // i      ch      a
-    "-----",  // 0      0       48
-    ".----",  // 1      1       49
-    "..---",  // 2      2       50
-    "...--",  // 3      3       51
-    "....-",  // 4      4       52
-    ".....",  // 5      5       53
-    "-....",  // 6      6       54
-    "--...",  // 7      7       55
-    "---..",  // 8      8       56
-    "----.",  // 9      9       57
-    "",       // 10             58
-    "",       // 11             59
-    "",       // 12             60
-    "",       // 13             61
-    "",       // 14             62
-    "",       // 15             63
-    "",       // 16             64
-    ".-",     // 17     A       65
-    "-...",   // 18     B       66
-    "-.-.",   // 19     C       67
-    "-..",    // 20     D       68
-    ".",      // 21     E       69
-    "..-.",   // 22     F       70
-    "--.",    // 23     G       71
-    "....",   // 24     H       72
-    "..",     // 25     I       73
-    ".---",   // 26     J       74
-    "-.-",    // 27     K       75
-    ".-..",   // 28     L       76
-    "--",     // 29     M       77
-    "-.",     // 30     N       78
-    "---",    // 31     O       79
-    ".--.",   // 32     P       80
-    "--.-",   // 33     Q       81
-    ".-.",    // 34     R       82
-    "...",    // 35     S       83
-    "-",      // 36     T       84
-    "..-",    // 37     U       85
-    "...-",   // 38     V       86
-    ".--",    // 39     W       87
-    "-..-",   // 40     X       88
-    "-.--",   // 41     Y       89
-    "--..",   // 42     Z       90
+// Opt-in alternative to morse_cb. If set, it is called instead, and
+// only when the signal changes. offset_ms is the time since the
+// previous morse_update() call at which the change occurred, so that
+// callers with coarse ticks can compensate for the delay.
+void (*morse_edge_cb)(bool value, uint32_t offset_ms);
+
+#if MORSE_TRACE
+// Optional, called as messages played by morse_update() start, end and
+// are switched.
+void (*morse_trace_cb)(morse_trace event);
+#endif  // MORSE_TRACE
+
+// Value of morse_ctx::live_entry if the live message is not queued.
+#define MORSE_NO_ENTRY 0xFF
+
+// Context driven by the single-channel functions above.
+static morse_ctx morse_default_ctx = {
+#if MORSE_MAX_LEN > 0
+    .live_buf = morse_default_ctx.storage[0],
+    .buf1 = morse_default_ctx.storage[0],
+    .buf2 = morse_default_ctx.storage[1],
+    .buf_size = MORSE_MAX_LEN,
+#endif  // MORSE_MAX_LEN
+    .live_timing = {120, 120},  // ms  ~= 10wpm
+    .timing = {120, 120},
+    .stream_timing = {120, 120},
+    .live_entry = MORSE_NO_ENTRY,
+#if MORSE_LOOP_LEN > 0
+    .loop = morse_default_ctx.loop_storage,
+    .loop_size = MORSE_LOOP_LEN,
+#endif  // MORSE_LOOP_LEN
+};
+
+/**
+ * \brief Precomputed on/off pattern of a single character.
+ *
+ * Patterns are stored first-dot-duration-first in the least
+ * significant bit, and include the gaps that precede the character,
+ * so that a character can be appended to an encoded message with a
+ * single shift and or.
+ */
+typedef struct {
+    uint32_t bits;
+    uint8_t len;  // In dot durations. Zero if char has no pattern.
+    uint8_t prosign;  // MORSE_PROSIGN_* if char delimits a prosign.
+} morse_glyph;
+
+enum {
+    MORSE_PROSIGN_START = 1,  // '<'
+    MORSE_PROSIGN_END,  // '>'
+};
+
+// State of joining the characters of a prosign, kept between
+// morse_lookup() calls.
+enum {
+    MORSE_JOIN_NONE = 0,  // Not in a prosign.
+    MORSE_JOIN_FIRST = 1,  // Before the first character of a prosign.
+    MORSE_JOIN_NEXT = 2,  // After it. Also the dot durations dropped.
+};
+
+#define GLYPH(c, bits, len) [c] = {bits, len, 0},
+#define LETTER(c, bits, len) \
+        GLYPH(c, bits, len) GLYPH((c) - 'A' + 'a', bits, len)
+
+// Dense table of every byte, so that each character is encoded with
+// a single lookup. Bytes without a pattern are all zero.
+static const morse_glyph glyphs[256] = {
+    MORSE_GLYPHS(GLYPH, LETTER)
+    ['<'] = {0, 0, MORSE_PROSIGN_START},
+    ['>'] = {0, 0, MORSE_PROSIGN_END},
+};
+
+// Pattern of characters left out by MORSE_POLICY_SKIP.
+static const morse_glyph morse_no_glyph = {0, 0, 0};
+
+/**
+ * \brief Builds a morse_index as characters are encoded.
+ */
+typedef struct {
+    morse_index *index;  // NULL if none is wanted.
+    uint32_t chars;  // Characters started so far.
+    uint32_t gaps;  // Dot durations timed by gap_ms so far.
+    uint32_t pending;  // Off dot durations at the end, not yet in gaps.
+} morse_indexer;
+
+// Start of every message.
+static const morse_mark morse_first_mark = {0, 0, 0, 0};
+
+#undef GLYPH
+#undef LETTER
+
+/**
+ * \brief Appends bits to an encoded buffer through a 64 bit
+ * accumulator, which is flushed one 32 bit word at a time.
+ */
+typedef struct {
+    uint8_t *buf;
+    uint32_t index;  // Bit index in buf of the first bit in acc.
+    uint32_t limit;  // Size of buf in bits.
+    uint64_t acc;
+    uint32_t acc_len;
+    bool quiet;  // Whether errors are not reported on stderr.
+} morse_writer;
+
+static const morse_run_cursor morse_run_start = {0, 0, 0, true};
+
+// Instrumentation, which compiles to nothing unless enabled.
+#if MORSE_STATS
+  #define MORSE_COUNT(stats, stat) morse_count((stats), (stat))
+  #define MORSE_COUNT_MAX(stats, stat, value) \
+      morse_count_max((stats), (stat), (value))
+  #define MORSE_COUNT_SHARED(stat) MORSE_COUNT_SHARED_N(stat, 1)
+  #define MORSE_COUNT_SHARED_N(stat, n) \
+      atomic_fetch_add_explicit( \
+              &morse_shared_stats[stat], (n), memory_order_relaxed)
+#else
+  #define MORSE_COUNT(stats, stat) ((void) 0)
+  #define MORSE_COUNT_MAX(stats, stat, value) ((void) 0)
+  #define MORSE_COUNT_SHARED(stat) ((void) 0)
+  #define MORSE_COUNT_SHARED_N(stat, n) ((void) 0)
+#endif  // MORSE_STATS
+#if MORSE_TRACE
+  #define MORSE_TRACE_EVENT(ctx, event) \
+      do { \
+          if ((ctx)->trace_cb) (ctx)->trace_cb((ctx), (event)); \
+      } while (0)
+#else
+  #define MORSE_TRACE_EVENT(ctx, event) ((void) 0)
+#endif  // MORSE_TRACE
+
+#if MORSE_STATS
+// Counts of encodes made without a context, by any thread.
+static MORSE_ATOMIC(uint32_t) morse_shared_stats[MORSE_STAT_COUNT];
+#endif  // MORSE_STATS
+
+// States of the next buffer of a context, which is handed from the
+// producer to the consumer through the pending field, and of each
+// entry of a queue.
+enum {
+    MORSE_SLOT_FREE,  // Owned by the producer.
+    MORSE_SLOT_READY,  // Holds a message that the consumer may take.
+    MORSE_SLOT_TAKING,  // Consumer is making the message live.
+    MORSE_SLOT_DONE,  // Entry has been played and may be freed.
 };
 
 
 // --------------------------------------------------------------------
 
 
-static void morse_switch_buf(void);
-static bool morse_encode(uint8_t *buf, const char *s, const uint32_t size);
-static void morse_encode_len(uint8_t *buf, const uint32_t bit_len);
+static void morse_switch_buf(morse_ctx *ctx);
+static void morse_start_run(morse_ctx *ctx, uint32_t pos);
+static void morse_loop_compile(morse_ctx *ctx);
+static bool morse_loop_start(morse_ctx *ctx, uint32_t pos);
+static bool morse_loop_usable(morse_ctx *ctx);
+static bool morse_loop_skippable(morse_ctx *ctx);
+static void morse_loop_seek(morse_ctx *ctx);
+static void morse_claim_next(morse_ctx *ctx);
+static void morse_publish_append(
+        morse_ctx *ctx, uint8_t *buf, uint32_t len, bool extended);
+static void morse_take_interrupt(morse_ctx *ctx);
+static void morse_take_preempt(morse_ctx *ctx);
+static void morse_cut(morse_ctx *ctx);
+static bool morse_replay(morse_ctx *ctx);
+static bool morse_queued(const morse_ctx *ctx);
+static uint8_t morse_queue_best(const morse_queue *queue);
+static void morse_queue_take(morse_ctx *ctx, uint8_t index);
+static void morse_queue_release(morse_ctx *ctx);
+static void morse_queue_free(morse_queue *queue);
+static uint32_t morse_queue_encode(
+        morse_queue *queue,
+        const char *s,
+        size_t n,
+        uint8_t format,
+        morse_glyph invalid,
+        uint32_t *offset);
+static uint32_t morse_cache_hash(
+        const char *s, size_t n, uint8_t format, uint8_t policy);
+static morse_cache_entry *morse_cache_find(
+        morse_ctx *ctx, const char *s, size_t n, uint32_t hash);
+static morse_cache_entry *morse_cache_fill(
+        morse_ctx *ctx, const char *s, size_t n, uint32_t hash);
+static uint32_t morse_encode_format(
+        uint8_t *buf,
+        const char *s,
+        size_t n,
+        uint32_t size,
+        uint8_t format,
+        morse_glyph invalid,
+        morse_index *index,
+        uint8_t *join,
+        bool quiet);
+static uint32_t morse_size_valid(
+        const char *s, size_t n, uint8_t format, morse_glyph invalid);
+static bool morse_accept(const char *s, size_t n, uint8_t policy);
+static morse_glyph morse_invalid_glyph(uint8_t policy);
+static morse_glyph morse_lookup(
+        uint8_t c, morse_glyph invalid, uint8_t *join);
+static void morse_report_invalid(const char *s);
+static void morse_set_level(
+        morse_ctx *ctx, const bool value, const uint32_t offset_ms);
+static void morse_default_callbacks(void);
+static void morse_default_cb(morse_ctx *ctx, bool value);
+static void morse_default_edge_cb(
+        morse_ctx *ctx, bool value, uint32_t offset_ms);
+#if MORSE_TRACE
+static void morse_default_trace_cb(morse_ctx *ctx, morse_trace event);
+#endif  // MORSE_TRACE
+#if MORSE_STATS
+static void morse_count(MORSE_ATOMIC(uint32_t) *stats, morse_stat stat);
+static void morse_count_max(
+        MORSE_ATOMIC(uint32_t) *stats, morse_stat stat, uint32_t value);
+#endif  // MORSE_STATS
+
+static bool morse_live_bit(
+        const morse_ctx *ctx, morse_run_cursor *run, uint32_t i);
+static uint32_t morse_live_edge(
+        const morse_ctx *ctx, morse_run_cursor *run, uint32_t i);
+static uint32_t morse_run_ms(const morse_ctx *ctx);
+
+static bool morse_seekable(const morse_ctx *ctx);
+static const morse_mark *morse_find_mark(
+        const morse_ctx *ctx, uint32_t unit, uint32_t time_ms, uint32_t *chr);
+static uint32_t morse_mark_time(const morse_ctx *ctx, const morse_mark *mark);
+static void morse_seek_mark(morse_ctx *ctx, const morse_mark *mark);
+static void morse_seek_unit(
+        morse_ctx *ctx, const morse_mark *mark, uint32_t unit);
+static uint32_t morse_next_char(
+        const morse_ctx *ctx, morse_run_cursor *run, uint32_t unit);
+static uint32_t morse_duration(morse_ctx *ctx);
+
+static morse_indexer morse_index_start(morse_index *index);
+static void morse_index_glyph(
+        morse_indexer *x, morse_glyph glyph, uint32_t unit, uint32_t run_pos);
+static void morse_index_end(morse_indexer *x);
+static void morse_index_add(
+        morse_index *index,
+        uint32_t chr,
+        morse_mark mark);
 
-static uint8_t morse_encode_char(
-        uint8_t *buf, char c, uint32_t index, uint32_t limit);
+static uint32_t morse_encode_valid(
+        uint8_t *buf,
+        const char *s,
+        size_t n,
+        const uint32_t size,
+        morse_glyph invalid,
+        morse_index *index,
+        uint8_t *join,
+        bool quiet);
+static bool morse_valid(const char *s, size_t n);
+static uint64_t morse_valid_word(uint64_t x);
+static uint32_t morse_encode_runs(
+        uint8_t *buf,
+        const char *s,
+        size_t n,
+        const uint32_t size,
+        morse_glyph invalid,
+        morse_index *index,
+        bool quiet);
+static void morse_encode_len(uint8_t *buf, const uint32_t bit_len);
 
-static bool morse_encode_bit(
-        uint8_t *buf, bool value, uint8_t n, uint32_t *index, uint32_t limit);
+static bool morse_writer_init(
+        morse_writer *w, uint8_t *buf, const uint32_t size, bool quiet);
+static void morse_writer_resume(
+        morse_writer *w, uint8_t *buf, uint32_t size, uint32_t bit_index);
+static bool morse_write(morse_writer *w, const uint32_t bits, uint32_t n);
+static bool morse_write_off_run(morse_writer *w, uint32_t units);
+static uint32_t morse_write_end(morse_writer *w);
+static void morse_encode_word(uint8_t *buf, const uint32_t word);
+static uint32_t morse_load_word(
+        const uint8_t *buf, uint32_t bit_index, uint32_t len);
+static uint32_t morse_word_edge(uint32_t bits, bool value, uint32_t from);
+static unsigned morse_ctz(uint32_t x);
 
-static bool morse_bit(const uint8_t *buf, const uint32_t bit_index);
-static uint32_t morse_len(const uint8_t *buf);
+static void morse_run_seek(
+        const uint8_t *buf, morse_run_cursor *run, uint32_t i);
+static void morse_run_next(const uint8_t *buf, morse_run_cursor *run);
 
 
 // --------------------------------------------------------------------
@@ -112,9 +323,7 @@ static uint32_t morse_len(const uint8_t *buf);
  * \param bool Whether string should be repeated.
  */
 void morse(const char *s, bool repeat) {
-    morse_encode(morse_next_buf, s, MORSE_MAX_LEN);
-    morse_repeat_next = repeat;
-    morse_repeat = false;
+    morse_ctx_send(&morse_default_ctx, s, repeat);
 }
 
 /**
@@ -123,194 +332,2572 @@ void morse(const char *s, bool repeat) {
  * \param elapsed_ms time since last update was called.
  */
 void morse_update(uint32_t elapsed_ms) {
-    // If nothing is in the live buffer, return.
-    const uint32_t live_len = morse_len(morse_live_buf);
-    if (!live_len && !morse_len(morse_next_buf)) return;
-    morse_elapsed_time += elapsed_ms;
-    const uint32_t bit_index = morse_elapsed_time / morse_dot_duration;
+    morse_default_callbacks();
+    morse_ctx_update(&morse_default_ctx, elapsed_ms);
+}
 
-    // If bit index is past end of used buffer, switch to next buf.
-    if (bit_index >= live_len) {
-        if (!morse_repeat) morse_switch_buf();
-        morse_elapsed_time = 0;
-    }
+/**
+ * \brief Get time remaining until the signal next changes.
+ *
+ * See morse_ctx_next_edge().
+ */
+uint32_t morse_next_edge(void) {
+    return morse_ctx_next_edge(&morse_default_ctx);
+}
 
-    // Set current signal.
-    morse_cb(morse_bit(morse_live_buf, bit_index));
+/**
+ * \brief Updates state from a monotonic clock in us.
+ *
+ * See morse_ctx_update_us().
+ */
+void morse_update_us(uint32_t now_us) {
+    morse_default_callbacks();
+    morse_ctx_update_us(&morse_default_ctx, now_us);
+}
+
+/**
+ * \brief Get time remaining until the signal next changes, in us.
+ *
+ * See morse_ctx_next_edge_us().
+ */
+uint32_t morse_next_edge_us(uint32_t now_us) {
+    return morse_ctx_next_edge_us(&morse_default_ctx, now_us);
 }
 
 /**
  * \brief Stop currently playing string after the current iteration.
  */
 void morse_stop(void) {
-    morse_repeat = false;
+    morse_ctx_stop(&morse_default_ctx);
+}
+
+/**
+ * \brief Set an already encoded message to be played.
+ *
+ * See morse_ctx_send_encoded().
+ */
+void morse_encoded(const uint8_t *buf, bool repeat) {
+    morse_ctx_send_encoded(&morse_default_ctx, buf, repeat);
+}
+
+/**
+ * \brief Add a string to the end of the last string set.
+ *
+ * See morse_ctx_append().
+ */
+bool morse_append(const char *s) {
+    return morse_ctx_append(&morse_default_ctx, s);
+}
+
+/**
+ * \brief Complete the string added to with morse_append().
+ *
+ * See morse_ctx_append_end().
+ */
+void morse_append_end(void) {
+    morse_ctx_append_end(&morse_default_ctx);
+}
+
+/**
+ * \brief Queue characters to be played after the current string.
+ *
+ * See morse_ctx_stream().
+ */
+size_t morse_stream(const char *s, size_t n) {
+    return morse_ctx_stream(&morse_default_ctx, s, n);
 }
 
 /**
  * \brief Interrupt the currently playing string immediately.
  */
 void morse_interrupt(void) {
-    morse_encode_len(morse_live_buf, 0);
-    morse_repeat = false;
+    morse_ctx_interrupt(&morse_default_ctx);
+}
+
+/**
+ * \brief Move the playing string to a time since it started.
+ *
+ * See morse_ctx_seek().
+ */
+bool morse_seek(uint32_t time_ms) {
+    return morse_ctx_seek(&morse_default_ctx, time_ms);
+}
+
+/**
+ * \brief Set speed of strings passed to morse() or morse_stream() from
+ * now on.
+ *
+ * See morse_wpm().
+ */
+void morse_set_timing(morse_timing timing) {
+    morse_default_ctx.timing = timing;
+}
+
+/**
+ * \brief Set handling of characters without a pattern in strings
+ * passed to morse() or morse_stream() from now on.
+ */
+void morse_set_policy(morse_policy policy) {
+    morse_default_ctx.policy = policy;
+}
+
+/**
+ * \brief Set queue used by morse_enqueue(), which must have been
+ * prepared by morse_queue_init().
+ */
+void morse_set_queue(morse_queue *queue) {
+    morse_default_ctx.queue = queue;
+}
+
+/**
+ * \brief Set cache used by morse(), which must have been prepared by
+ * morse_cache_init(), or NULL to stop using one.
+ */
+void morse_set_cache(morse_cache *cache) {
+    morse_default_ctx.cache = cache;
+}
+
+/**
+ * \brief Replace the buffers strings passed to morse() are encoded
+ * into.
+ *
+ * Must be called before anything is played. See
+ * morse_ctx_init_buffers().
+ */
+void morse_set_buffers(uint8_t *mem, size_t size) {
+    morse_ctx_init_buffers(&morse_default_ctx, mem, size);
+}
+
+/**
+ * \brief Queue a string to be played.
+ *
+ * See morse_ctx_enqueue().
+ */
+bool morse_enqueue(
+        const char *s, uint8_t plays, uint8_t priority, bool preempt) {
+    return morse_ctx_enqueue(&morse_default_ctx, s, plays, priority, preempt);
+}
+
+/**
+ * \brief Get a counter of the messages played by the functions above.
+ *
+ * See morse_ctx_get_stat().
+ */
+uint32_t morse_get_stat(morse_stat stat) {
+    return morse_ctx_get_stat(&morse_default_ctx, stat);
 }
 
 
 // --------------------------------------------------------------------
 
 
-static void morse_switch_buf(void) {
-    if (morse_live_buf == morse_buf1) {
-        morse_live_buf = morse_buf2;
-        morse_next_buf = morse_buf1;
-    } else {
-        morse_live_buf = morse_buf1;
-        morse_next_buf = morse_buf2;
+/**
+ * \brief Prepare a context for use.
+ *
+ * The context plays nothing until a string is passed to
+ * morse_ctx_send(). Callbacks and user data may be set on the context
+ * after it is initialized.
+ */
+void morse_ctx_init(morse_ctx *ctx) {
+#if MORSE_MAX_LEN > 0
+    morse_ctx_init_buffers(ctx, ctx->storage[0], sizeof(ctx->storage));
+#else
+    morse_ctx_init_buffers(ctx, NULL, 0);
+#endif  // MORSE_MAX_LEN
+}
+
+/**
+ * \brief Prepare a context for use, as morse_ctx_init(), with buffers
+ * in caller-supplied memory instead of those built into the context.
+ *
+ * mem is split into two buffers of half its size, one of which is
+ * played while the next string is encoded into the other, and must
+ * outlive the context. Each buffer must have room for the longest
+ * string passed to morse_ctx_send(), which is given by
+ * morse_encoded_size(). If size is zero, strings can only be played
+ * with morse_ctx_send_encoded(), queued or streamed.
+ */
+void morse_ctx_init_buffers(morse_ctx *ctx, uint8_t *mem, size_t size) {
+    memset(ctx, 0, offsetof(morse_ctx, buf1));
+    size /= 2;
+    ctx->buf1 = mem;
+    ctx->buf2 = mem ? mem + size : NULL;
+    ctx->buf_size = size > UINT32_MAX ? UINT32_MAX : (uint32_t) size;
+    ctx->live_buf = ctx->buf1;
+    ctx->timing = (morse_timing) {120, 120};
+    ctx->live_timing = ctx->timing;
+    atomic_init(&ctx->stream_timing, ctx->timing);
+    ctx->live_entry = MORSE_NO_ENTRY;
+    if (ctx->buf_size >= 4) morse_encode_len(ctx->buf1, 0);
+#if MORSE_LOOP_LEN > 0
+    morse_ctx_init_loop(ctx, ctx->loop_storage, MORSE_LOOP_LEN);
+#endif  // MORSE_LOOP_LEN
+}
+
+/**
+ * \brief Give a context memory to cache the runs of repeating messages
+ * in, instead of that built into it.
+ *
+ * A repeating message with no more than n runs is timed once as it
+ * starts, rather than run by run on every play, so that each edge is
+ * a lookup, and an update spanning whole plays of it, with no edge_cb,
+ * takes the time modulo its length and a binary search. mem must
+ * outlive the context. Should be called only while nothing is playing.
+ */
+void morse_ctx_init_loop(morse_ctx *ctx, morse_loop_edge *mem, size_t n) {
+    ctx->loop = mem;
+    ctx->loop_size = !mem ? 0 : n > UINT32_MAX ? UINT32_MAX : (uint32_t) n;
+    ctx->loop_len = 0;
+}
+
+/**
+ * \brief Set a string to be played by a context.
+ *
+ * Behaves as morse(), for the passed context.
+ */
+void morse_ctx_send(morse_ctx *ctx, const char *s, bool repeat) {
+    morse_claim_next(ctx);
+    // Encode into whichever buffer the consumer cannot be playing.
+    uint8_t *buf = ctx->played_buf == ctx->buf1 ? ctx->buf2 : ctx->buf1;
+    morse_index *index = buf == ctx->buf1 ? &ctx->index1 : &ctx->index2;
+    const size_t n = strlen(s);
+    // Only accepted strings are cached, under the policy they were.
+    const uint32_t hash = ctx->cache && n <= MORSE_CACHE_TEXT
+            ? morse_cache_hash(s, n, ctx->format, ctx->policy) : 0;
+    morse_cache_entry *entry =
+            hash ? morse_cache_find(ctx, s, n, hash) : NULL;
+    const bool hit = entry != NULL;
+    const bool accepted = hit || morse_accept(s, n, ctx->policy);
+    if (hash && !hit && accepted) entry = morse_cache_fill(ctx, s, n, hash);
+    if (entry) {
+        buf = entry->buf;
+        index = &entry->index;
+    }
+    const bool encoded = entry || (accepted && morse_encode_format(
+            buf, s, n, ctx->buf_size, ctx->format,
+            morse_invalid_glyph(ctx->policy), index, &ctx->append_join,
+            false));
+    MORSE_COUNT(ctx->stats, hit ? MORSE_STAT_CACHE_HITS
+            : !accepted ? MORSE_STAT_INVALID
+            : !encoded ? MORSE_STAT_TOO_LONG : MORSE_STAT_ENCODES);
+    atomic_store_explicit(&ctx->repeat, false, memory_order_relaxed);
+    // A message of bits may be appended to, from where its text ends,
+    // unless it is cached to be sent again.
+    ctx->append_buf = NULL;
+    if (encoded && !entry && ctx->format == MORSE_FORMAT_BITS) {
+        ctx->append_buf = buf;
+        ctx->append_len = morse_len(buf) - 4 * glyphs[' '].len;
+    }
+    ctx->append_open = false;
+    if (encoded) {
+        ctx->next_buf = buf;
+        ctx->next_index = index;
+        ctx->next_format = ctx->format;
+        ctx->next_timing = ctx->timing;
+        ctx->repeat_next = repeat;
+        atomic_store_explicit(
+                &ctx->pending, MORSE_SLOT_READY, memory_order_release);
     }
-    morse_repeat = morse_repeat_next;
-    morse_repeat_next = false;
-    morse_encode_len(morse_next_buf, 0);  // Clear buf.
 }
 
-static bool morse_encode(uint8_t *buf, const char *s, const uint32_t size) {
-    if (size < 4) {
-        fprintf(stderr, "Buffer must have size of >= 5.");
+/**
+ * \brief Set an already encoded message to be played by a context.
+ *
+ * Behaves as morse_ctx_send(), but plays buf in place, which must
+ * remain unchanged until it has finished playing. This allows messages
+ * encoded at compile time (see morse.hpp) to be played from flash
+ * without an encode or copy.
+ *
+ * \param buf Message in the layout produced for MORSE_FORMAT_BITS: a
+ *      32 bit big endian length in dot durations, followed by one bit
+ *      per dot duration, lsb first.
+ */
+void morse_ctx_send_encoded(
+        morse_ctx *ctx, const uint8_t *buf, bool repeat) {
+    morse_claim_next(ctx);
+    ctx->append_buf = NULL;
+    ctx->next_buf = buf;
+    ctx->next_index = NULL;
+    ctx->next_format = MORSE_FORMAT_BITS;
+    ctx->next_timing = ctx->timing;
+    ctx->repeat_next = repeat;
+    atomic_store_explicit(&ctx->repeat, false, memory_order_relaxed);
+    atomic_store_explicit(
+            &ctx->pending, MORSE_SLOT_READY, memory_order_release);
+}
+
+/**
+ * \brief Add a string to the end of the message last set on a context,
+ * without encoding what it already holds again.
+ *
+ * If the message last set by morse_ctx_send() or morse_ctx_append()
+ * has not started to play, s is encoded into its buffer from where its
+ * text ends, in place of its padding, so that a message built up from
+ * many parts takes time linear in its length. If it has started, s is
+ * encoded into the other buffer, as the consumer may be reading any
+ * byte of the live one, and played straight after it, as send would.
+ * Otherwise s starts a new message. Prosigns carry on from one part to
+ * the next.
+ *
+ * The end of message padding is left off while a message is appended
+ * to, so that parts follow each other with only the gaps they hold,
+ * and is written once by morse_ctx_append_end(). Appended messages are
+ * of MORSE_FORMAT_BITS, have no index, and keep the timing and repeat
+ * of the message they extend, or play once at the timing of the
+ * context. A message set with morse_ctx_send_encoded(), or sent from
+ * a morse_cache, is never appended to.
+ *
+ * \return Whether s was added. If not, as s holds a character without a
+ *      pattern under MORSE_POLICY_ERROR, or the message would not fit,
+ *      the message is left as it was.
+ */
+bool morse_ctx_append(morse_ctx *ctx, const char *s) {
+    const size_t n = strlen(s);
+    if (!morse_accept(s, n, ctx->policy)) {
+        MORSE_COUNT(ctx->stats, MORSE_STAT_INVALID);
         return false;
     }
-    uint32_t i = 32;  // Skip length bytes.
-    const uint32_t bit_size = size * 8;
-    for (const char *c = s; *c != '\0'; ++c) {
-        uint32_t char_len = morse_encode_char(buf, *c, i, bit_size);
-        if (!char_len) return false;
-        i += char_len;
+    if (ctx->buf_size < 4) {
+        MORSE_REPORT("Buffer must have size of >= 5.");
+        return false;
     }
-    // Add padding to message end to help separate messages.
-    for (uint8_t j = 0; j < 4; ++j) {
-        uint32_t char_len = morse_encode_char(buf, ' ', i, bit_size);
-        if (!char_len) return false;
-        i += char_len;
+    const morse_glyph invalid = morse_invalid_glyph(ctx->policy);
+    const uint8_t *const next = ctx->next_buf;
+    morse_claim_next(ctx);
+    const bool extended = next && !ctx->next_buf;
+    if (extended && next != ctx->append_buf) {
+        // Withdrawn, but played in place from the caller's memory.
+        ctx->next_buf = next;
+        atomic_store_explicit(
+                &ctx->pending, MORSE_SLOT_READY, memory_order_release);
+        return false;
+    }
+    uint8_t *buf = ctx->append_buf;
+    uint32_t bit = ctx->append_len;
+    uint8_t join = ctx->append_join;
+    if (!extended) {
+        // A part of the live message carries on its prosign, if open.
+        if (!ctx->append_open || ctx->played_buf != ctx->append_buf) {
+            join = MORSE_JOIN_NONE;
+        }
+        buf = ctx->played_buf == ctx->buf1 ? ctx->buf2 : ctx->buf1;
+        bit = 0;
+    }
+    // Measure first, so that a part which does not fit leaves the
+    // message whole, and so does its padding once written.
+    uint64_t len = bit;
+    uint8_t state = join;
+    for (size_t i = 0; i < n; ++i) {
+        len += morse_lookup((uint8_t) s[i], invalid, &state).len;
+    }
+    if (4 + (len + 4 * glyphs[' '].len + 7) / 8 > ctx->buf_size) {
+        MORSE_REPORT("Buffer size limit reached.");
+        MORSE_COUNT(ctx->stats, MORSE_STAT_TOO_LONG);
+        if (extended) morse_publish_append(ctx, buf, morse_len(buf), true);
+        return false;
     }
-    morse_encode_len(buf, i - 32);
+    morse_writer w;
+    morse_writer_resume(&w, buf, ctx->buf_size, bit);
+    for (size_t i = 0; i < n; ++i) {
+        const morse_glyph glyph = morse_lookup((uint8_t) s[i], invalid, &join);
+        morse_write(&w, glyph.bits, glyph.len);
+    }
+    ctx->append_len = morse_write_end(&w);
+    ctx->append_join = join;
+    ctx->append_open = true;
+    morse_publish_append(ctx, buf, ctx->append_len, extended);
+    MORSE_COUNT(ctx->stats, MORSE_STAT_ENCODES);
     return true;
 }
 
-static void morse_encode_len(uint8_t *buf, const uint32_t bit_len) {
-    buf[0] = (bit_len & 0xFF000000) >> 24;
-    buf[1] = (bit_len & 0x00FF0000) >> 16;
-    buf[2] = (bit_len & 0x0000FF00) >> 8;
-    buf[3] = (bit_len & 0x000000FF);
+/**
+ * \brief Write the end of message padding of the message appended to
+ * by morse_ctx_append(), once it is complete.
+ *
+ * If the message has started to play, the padding is set to play
+ * straight after it instead, as a message of its own. Appending again
+ * carries on from the end of the text, before the padding.
+ */
+void morse_ctx_append_end(morse_ctx *ctx) {
+    if (!ctx->append_buf || !ctx->append_open) return;
+    const uint8_t *const next = ctx->next_buf;
+    morse_claim_next(ctx);
+    const bool extended = next && !ctx->next_buf;
+    ctx->append_open = false;
+    if (extended && next != ctx->append_buf) {
+        ctx->next_buf = next;
+        atomic_store_explicit(
+                &ctx->pending, MORSE_SLOT_READY, memory_order_release);
+        return;
+    }
+    uint8_t *const buf = extended ? ctx->append_buf
+            : ctx->played_buf == ctx->buf1 ? ctx->buf2 : ctx->buf1;
+    const uint32_t bit = extended ? ctx->append_len : 0;
+    morse_writer w;
+    morse_writer_resume(&w, buf, ctx->buf_size, bit);
+    morse_write(&w, 0, 4 * glyphs[' '].len);
+    morse_publish_append(ctx, buf, morse_write_end(&w), extended);
+    // Text appended later goes before the padding, if it is in place.
+    if (!extended) ctx->append_buf = NULL;
 }
 
-static uint8_t morse_encode_char(
-        uint8_t *buf,
-        const char ch,
-        const uint32_t index,
-        const uint32_t limit) {
-    uint32_t i = index;
-    const char c = toupper(ch);
-    // If c is a space; add four dot durations of silence.
-    // Combined with the two spaces at the start of a character,
-    // and the one space at the start of each element, forms the 7
-    // dot durations of separation that are expected between words.
-    if (c == ' ') {
-        if (!morse_encode_bit(buf, 0, 4, &i, limit)) return 0;
-    } else {
-        if (c < OFFSET || c > MAX_CHAR) {
-            fprintf(stderr, "Invalid char: %c", ch);
-            return 0;
+/**
+ * \brief Queue characters to be played by a context as a stream.
+ *
+ * Characters are kept in a ring buffer of MORSE_STREAM_LEN characters
+ * and each is encoded just before it is played, so text of any length
+ * can be played in constant memory by pushing it a part at a time.
+ * Streamed characters are played once the current string is complete,
+ * and after any string passed to morse_ctx_send(), which begins at the
+ * next character boundary. A repeating string finishes its current
+ * iteration and then stops.
+ *
+ * If the stream runs dry, the signal stays off until more characters
+ * are pushed, so callers pushing text as it is produced should push
+ * spaces between words themselves.
+ *
+ * \param s Characters to transmit, not necessarily null terminated.
+ * \param n Number of characters in s.
+ * \return Number of characters queued. Less than n if the ring buffer
+ *      is full, or if an invalid character is reached.
+ */
+size_t morse_ctx_stream(morse_ctx *ctx, const char *s, size_t n) {
+    const uint16_t tail =
+            atomic_load_explicit(&ctx->stream_tail, memory_order_acquire);
+    uint16_t head =
+            atomic_load_explicit(&ctx->stream_head, memory_order_relaxed);
+    size_t i = 0;
+    for (; i < n && (uint16_t) (head - tail) != MORSE_STREAM_LEN; ++i) {
+        char c = s[i];
+        const morse_glyph glyph = glyphs[(uint8_t) c];
+        if (!glyph.len && !glyph.prosign) {
+            if (ctx->policy == MORSE_POLICY_SKIP) continue;
+            if (ctx->policy == MORSE_POLICY_ERROR) {
+                MORSE_REPORT("Invalid char: %c", c);
+                MORSE_COUNT(ctx->stats, MORSE_STAT_INVALID);
+                break;
+            }
+            c = '?';
         }
-        // Append two empty dot durations at the start of a character.
-        // Combines with empty dot duration at start of element to form
-        // the expected three-dot 'off' period at the start of a char.
-        if (!morse_encode_bit(buf, 0, 2, &i, limit)) return 0;
-        const char * const series = letters[c - OFFSET];
-        for (const char *element = series; *element != '\0'; ++element) {
-            // Add empty dot duration as spacing at start of element.
-            if (!morse_encode_bit(buf, 0, 1, &i, limit)) return 0;
-            if (*element == '.') {
-                if (!morse_encode_bit(buf, 1, 1, &i, limit)) return 0;
-            } else {
-                if (!morse_encode_bit(buf, 1, 3, &i, limit)) return 0;
+        ctx->stream[head % MORSE_STREAM_LEN] = c;
+        ++head;
+    }
+    if (i) {
+        atomic_store_explicit(
+                &ctx->stream_timing, ctx->timing, memory_order_relaxed);
+        atomic_store_explicit(&ctx->repeat, false, memory_order_relaxed);
+        atomic_store_explicit(&ctx->stream_head, head, memory_order_release);
+    }
+    return i;
+}
+
+/**
+ * \brief Updates context state, intended to be called regularly.
+ *
+ * If the context has an edge_cb, it is called on each change of the
+ * signal since the last update. Otherwise cb is called with the
+ * current signal. Time past the end of a message is carried into its
+ * repetition, or the message after it, so their edges do not drift
+ * with the update interval.
+ *
+ * \param elapsed_ms time since last update was called.
+ */
+void morse_ctx_update(morse_ctx *ctx, uint32_t elapsed_ms) {
+    morse_take_interrupt(ctx);
+    morse_take_preempt(ctx);
+
+    // If nothing is in the live buffer, return.
+    if (!ctx->live_len && !morse_queued(ctx)) {
+        // Signal may have been left on by morse_ctx_interrupt().
+        if (ctx->edge_cb) morse_set_level(ctx, false, 0);
+        ctx->clock_us += elapsed_ms * 1000;
+        return;
+    }
+    MORSE_COUNT_MAX(ctx->stats, MORSE_STAT_MAX_ELAPSED, elapsed_ms);
+    // Start of the elapsed time, in the time of the live message. Moves
+    // back by the length of each message that ends within it.
+    uint32_t window_start = ctx->elapsed_time;
+    ctx->elapsed_time += elapsed_ms;
+    if (ctx->edge_cb && ctx->pos < ctx->live_len) {
+        morse_set_level(ctx, ctx->run_level, 0);
+    }
+
+    for (;;) {
+        // With only the final signal wanted, the runs of a cached
+        // message need not be visited in turn.
+        if (morse_loop_skippable(ctx) &&
+                ctx->elapsed_time >= ctx->edge_time) {
+            morse_loop_seek(ctx);
+        }
+
+        // Report each change since the last update, in order. Runs are
+        // timed as they start, so no division is needed.
+        while (ctx->elapsed_time >= ctx->edge_time &&
+                ctx->edge < ctx->live_len) {
+            const uint32_t offset_ms = ctx->edge_time - window_start;
+            MORSE_COUNT_MAX(ctx->stats, MORSE_STAT_MAX_LATE,
+                    ctx->elapsed_time - ctx->edge_time);
+            morse_start_run(ctx, ctx->edge);
+            if (ctx->edge_cb) {
+                morse_set_level(ctx, ctx->run_level, offset_ms);
+            }
+        }
+        if (ctx->elapsed_time < ctx->edge_time) break;
+
+        // The last run has ended, so switch to next buf.
+        const uint32_t end_time = ctx->edge_time;
+        const bool ended = ctx->live_len;
+        if (ended) {
+            MORSE_COUNT_MAX(ctx->stats, MORSE_STAT_MAX_LATE,
+                    ctx->elapsed_time - end_time);
+            MORSE_TRACE_EVENT(ctx, MORSE_TRACE_END);
+        }
+        const bool replayed = morse_replay(ctx);
+        if (!replayed) {
+            morse_switch_buf(ctx);
+            if (ctx->live_len) {
+                MORSE_COUNT(ctx->stats, MORSE_STAT_SWITCHES);
+                MORSE_TRACE_EVENT(ctx, MORSE_TRACE_SWITCH);
             }
         }
+        if (ctx->live_len && !ctx->loop_len &&
+                atomic_load_explicit(&ctx->repeat, memory_order_relaxed)) {
+            morse_loop_compile(ctx);
+        }
+        // window_start wraps below zero once a message has ended within
+        // the elapsed time, so the offset is taken modulo 2^32.
+        const uint32_t start_offset = ended ? end_time - window_start : 0;
+        // A message following straight on from one that ended is
+        // started at that end, rather than at the end of the elapsed
+        // time, so that repeats and back to back messages keep their
+        // phase however the updates fall. Others start from now.
+        const bool carry = ended && ctx->live_len && end_time;
+        ctx->elapsed_time = carry ? ctx->elapsed_time - end_time : 0;
+        // Plays that would pass unseen are skipped all at once. Nothing
+        // is queued, or the message would not have been replayed.
+        if (carry && replayed && !ctx->plays && morse_loop_skippable(ctx)) {
+            const uint32_t period = ctx->loop[ctx->loop_len - 1].time_ms;
+            if (period) ctx->elapsed_time %= period;
+        }
+        window_start -= end_time;
+        ctx->edge_time = 0;
+        morse_start_run(ctx, 0);
+        if (ctx->live_len) MORSE_TRACE_EVENT(ctx, MORSE_TRACE_START);
+        if (ctx->edge_cb) {
+            morse_set_level(
+                    ctx, ctx->live_len && ctx->run_level, start_offset);
+        }
+        if (!carry) break;
+    }
+
+    // Set current signal.
+    if (!ctx->edge_cb) {
+        MORSE_COUNT(ctx->stats, MORSE_STAT_CALLBACKS);
+        ctx->cb(ctx, ctx->pos < ctx->live_len && ctx->run_level);
     }
-    return i - index;
+    ctx->clock_us += elapsed_ms * 1000;
 }
 
 /**
- * \brief Encode a bit indicating signal on or off.
- * 
- * This is assumed to be called sequentially on bits, And as writing
- * the first bit of a byte will clear the entire byte, writing bits
- * out-of-order will probably not result in expected behavior.
+ * \brief Update many contexts by the same elapsed time.
+ *
+ * Equivalent to calling morse_ctx_update() on each context in turn.
+ * As the state read on each update is kept at the start of each
+ * context, idle contexts only cost a read of one cache line each.
+ *
+ * \param ctxs Array of n contexts.
+ * \param elapsed_ms time since last update was called.
  */
-static bool morse_encode_bit(
-        uint8_t *buf,
-        const bool value,  // 0 or 1
-        const uint8_t n,
-        uint32_t *index,
-        const uint32_t limit) {
-    for (uint32_t i = *index; i < *index + n; ++i) {
-        if (i >= limit) {
-            fprintf(stderr, "Buffer size limit reached.");
-            buf[0] = buf[1] = buf[2] = buf[3] = 0;
-            return false;
-        }
-
-        uint8_t bit_index = i % 8;
-        uint32_t buf_index = i / 8;
-        // If this is the first bit of the byte,
-        // clear the whole byte.
-        if (!bit_index) buf[buf_index] = 0;
-        // Set bit
-        buf[buf_index] |= value << bit_index;
-    }
-    *index += n;
-    return true;
+void morse_update_all(morse_ctx *ctxs, size_t n, uint32_t elapsed_ms) {
+    for (morse_ctx *ctx = ctxs; ctx != ctxs + n; ++ctx) {
+        morse_ctx_update(ctx, elapsed_ms);
+    }
 }
 
-static bool morse_bit(const uint8_t *buf, const uint32_t bit_index) {
-    const uint32_t i = bit_index + 32;
-    return (buf[i / 8] >> (i % 8)) & 1;
+/**
+ * \brief Updates context state from a monotonic clock in us.
+ *
+ * As morse_ctx_update(), but passed the time now rather than the time
+ * since the last update, so that the caller keeps no count of its own.
+ * The context advances by whole ms, and keeps the rest for the next
+ * update, so that no time is lost however often it is called. The
+ * clock may wrap, and may be any free running us counter, such as a
+ * hardware timer scaled to us, but the context must be updated at
+ * least once per wrap while playing. A context with nothing to play
+ * takes up the clock on its next update, so needs no setting up.
+ * Should not be mixed with morse_ctx_update() on one context.
+ *
+ * \param now_us time on the clock.
+ */
+void morse_ctx_update_us(morse_ctx *ctx, uint32_t now_us) {
+    morse_ctx_update(ctx, (now_us - ctx->clock_us) / 1000);
 }
 
 /**
- * \brief Get length in bits / dot durations of encoded morse message.
+ * \brief Get the time on the clock of morse_ctx_update_us() of an edge
+ * passed to edge_cb.
+ *
+ * Edges fall on whole ms of the clock, so this is exact, however late
+ * the update was.
+ *
+ * \param offset_ms passed to edge_cb, which this must be called from.
  */
-static uint32_t morse_len(const uint8_t *buf) {
-    return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+uint32_t morse_ctx_edge_us(const morse_ctx *ctx, uint32_t offset_ms) {
+    return ctx->clock_us + offset_ms * 1000;
 }
 
-// --------------------------------------------------------------------
+/**
+ * \brief Get time remaining until the signal of a context next changes,
+ * on the clock of morse_ctx_update_us().
+ *
+ * Allows the caller to arm a us timer for the edge, and so play edges
+ * to within the accuracy of the timer, rather than of whole ms.
+ *
+ * \param now_us time on the clock.
+ * \return us until the next edge, 0 if it is due, or MORSE_NO_EDGE if
+ *      nothing is playing or queued.
+ */
+uint32_t morse_ctx_next_edge_us(const morse_ctx *ctx, uint32_t now_us) {
+    const uint32_t next_ms = morse_ctx_next_edge(ctx);
+    if (next_ms == MORSE_NO_EDGE) return MORSE_NO_EDGE;
+    if (next_ms > (MORSE_NO_EDGE - 1) / 1000) return MORSE_NO_EDGE - 1;
+    const uint32_t since_us = now_us - ctx->clock_us;
+    return next_ms * 1000 > since_us ? next_ms * 1000 - since_us : 0;
+}
 
+/**
+ * \brief Get time remaining until the signal of a context next changes.
+ *
+ * Allows the caller to sleep or arm a timer for exactly the returned
+ * time, and then pass it to morse_ctx_update(), rather than polling.
+ * At the end of a message, the time remaining in the message is
+ * returned instead, so that the next message or repetition is started
+ * on time. morse_ctx_send() does not wake a sleeping caller, so it
+ * should be followed by a call to morse_ctx_next_edge() to get the
+ * new deadline.
+ *
+ * \return ms until the next edge, or MORSE_NO_EDGE if nothing is
+ *      playing or queued.
+ */
+uint32_t morse_ctx_next_edge(const morse_ctx *ctx) {
+    const uint8_t interrupt_seq =
+            atomic_load_explicit(&ctx->interrupt_seq, memory_order_relaxed);
+    if (interrupt_seq != ctx->interrupt_ack) return 0;
+    const morse_queue *const queue = ctx->queue;
+    if (queue && atomic_load_explicit(
+            &queue->preempt_seq, memory_order_relaxed) != queue->preempt_ack) {
+        return 0;
+    }
+    if (!ctx->live_len) return morse_queued(ctx) ? 0 : MORSE_NO_EDGE;
+    if (ctx->elapsed_time >= ctx->edge_time) return 0;
+    return ctx->edge_time - ctx->elapsed_time;
+}
 
-#ifdef MORSE_MAIN
+/**
+ * \brief Stop string playing in context after the current iteration.
+ */
+void morse_ctx_stop(morse_ctx *ctx) {
+    atomic_store_explicit(&ctx->repeat, false, memory_order_relaxed);
+}
 
-static void morse_console(bool value) {
-    printf(value ? "\r    XXX    " : "\r           ");
-    fflush(stdout);
+/**
+ * \brief Interrupt the string playing in context immediately.
+ *
+ * Also discards any characters queued by morse_ctx_stream(). Messages
+ * queued by morse_ctx_enqueue() are kept, and the next of them starts
+ * at once. Takes effect on the next call to morse_ctx_update().
+ */
+void morse_ctx_interrupt(morse_ctx *ctx) {
+    const uint16_t head =
+            atomic_load_explicit(&ctx->stream_head, memory_order_relaxed);
+    atomic_store_explicit(&ctx->stream_drop, head, memory_order_relaxed);
+    atomic_store_explicit(&ctx->repeat, false, memory_order_relaxed);
+    const uint8_t seq =
+            atomic_load_explicit(&ctx->interrupt_seq, memory_order_relaxed);
+    atomic_store_explicit(
+            &ctx->interrupt_seq, (uint8_t) (seq + 1), memory_order_release);
 }
 
-int main(int argc, char **argv) {
-    // Set message.
-    if (argc > 1) {
-        morse(argv[1], true);
-    } else {
-        morse("Hello World", true);
+/**
+ * \brief Get the point reached in the live message of a context.
+ *
+ * Finds the character played from the index of the message, if it has
+ * one, in logarithmic time, and counts on from the nearest mark before
+ * it. Messages without an index, which are those queued or passed to
+ * morse_ctx_send_encoded(), are counted from the start. Only called by
+ * the consumer.
+ *
+ * \return Whether a message is live. False for streamed characters.
+ */
+bool morse_ctx_position(const morse_ctx *ctx, morse_position *position) {
+    if (!morse_seekable(ctx)) return false;
+    uint32_t unit = ctx->edge;
+    if (ctx->elapsed_time < ctx->edge_time) {
+        const uint32_t unit_ms = morse_run_ms(ctx);
+        const uint32_t left =
+                (ctx->edge_time - ctx->elapsed_time + unit_ms - 1) / unit_ms;
+        unit = left < ctx->edge - ctx->pos ? ctx->edge - left : ctx->pos;
     }
-    
-    // Set dot duration.
-    if (argc > 2) {
-        int dot_duration = atoi(argv[2]);
-        if (dot_duration <= 10) {
-            fprintf(stderr, "Invalid dot duration: %s", argv[2]);
+    uint32_t chr;
+    const morse_mark *const mark =
+            morse_find_mark(ctx, unit, UINT32_MAX, &chr);
+    morse_run_cursor run = {mark->run_pos, mark->run_start, 0, true};
+    uint32_t start = mark->unit;
+    for (;;) {
+        const uint32_t next = morse_next_char(ctx, &run, start);
+        if (next > unit || next == ctx->live_len) break;
+        start = next;
+        ++chr;
+    }
+    *position = (morse_position) {ctx->elapsed_time, unit, chr};
+    return true;
+}
+
+/**
+ * \brief Move the live message of a context to a time since it
+ * started.
+ *
+ * Lets transmitters that share a clock, but may have restarted, resume
+ * a message in step. Runs from the nearest mark before the time in the
+ * index of the message, found in logarithmic time. A repeating message
+ * is moved to the same point of the repetition the time falls in, and
+ * any other is moved to its end if the time is past it, so that it
+ * ends on the next update. Only called by the consumer, between
+ * updates.
+ *
+ * \return Whether a message is live. False for streamed characters.
+ */
+bool morse_ctx_seek(morse_ctx *ctx, uint32_t time_ms) {
+    if (!morse_seekable(ctx)) return false;
+    const uint32_t duration = morse_duration(ctx);
+    if (time_ms >= duration) {
+        if (atomic_load_explicit(&ctx->repeat, memory_order_relaxed)) {
+            time_ms = duration ? time_ms % duration : 0;
+        } else {
+            time_ms = duration;
         }
-        morse_dot_duration = dot_duration;
+    }
+    morse_seek_mark(ctx, morse_find_mark(ctx, UINT32_MAX, time_ms, NULL));
+    while (ctx->edge < ctx->live_len && ctx->edge_time <= time_ms) {
+        morse_start_run(ctx, ctx->edge);
+    }
+    ctx->elapsed_time = time_ms;
+    return true;
+}
+
+/**
+ * \brief Move the live message of a context to the start of a
+ * character.
+ *
+ * Characters are counted as for morse_position. The character is
+ * found from the index of the message, if it has one, in constant
+ * time, and otherwise by counting from the start. Only called by the
+ * consumer, between updates.
+ *
+ * \return Whether the message has the character. If not, the message
+ *      is left as it was.
+ */
+bool morse_ctx_seek_char(morse_ctx *ctx, const uint32_t chr) {
+    if (!morse_seekable(ctx)) return false;
+    const morse_index *const index = ctx->live_index;
+    const morse_mark *mark = &morse_first_mark;
+    uint32_t count = 0;
+    if (index && index->len) {
+        const uint32_t i = chr >> index->shift;
+        mark = &index->marks[i < index->len ? i : index->len - 1u];
+        count = (uint32_t) (mark - index->marks) << index->shift;
+    }
+    morse_run_cursor run = {mark->run_pos, mark->run_start, 0, true};
+    uint32_t unit = mark->unit;
+    const uint32_t end = ctx->live_len > 4 * glyphs[' '].len ?
+            ctx->live_len - 4 * glyphs[' '].len : 0;
+    for (; count < chr && unit < end; ++count) {
+        unit = morse_next_char(ctx, &run, unit);
+    }
+    if (unit >= end) return false;
+    morse_seek_unit(ctx, mark, unit);
+    return true;
+}
+
+/**
+ * \brief Get a counter of a context, if MORSE_STATS is set.
+ *
+ * Counters may be read by any thread while the context is in use.
+ * Each counts from morse_ctx_init() or morse_ctx_reset_stats(), and
+ * wraps.
+ *
+ * \param ctx Context, or NULL to get the counts of morse_encode() and
+ *      morse_encode_batch() in any thread.
+ * \return Value of the counter, or 0 if MORSE_STATS is not set.
+ */
+uint32_t morse_ctx_get_stat(const morse_ctx *ctx, morse_stat stat) {
+#if MORSE_STATS
+    return atomic_load_explicit(
+            ctx ? &ctx->stats[stat] : &morse_shared_stats[stat],
+            memory_order_relaxed);
+#else
+    (void) ctx;
+    (void) stat;
+    return 0;
+#endif  // MORSE_STATS
+}
+
+/**
+ * \brief Zero the counters of a context.
+ *
+ * If called while the context is in use, counts made at the same time
+ * may be lost.
+ */
+void morse_ctx_reset_stats(morse_ctx *ctx) {
+#if MORSE_STATS
+    for (size_t i = 0; i < MORSE_STAT_COUNT; ++i) {
+        atomic_store_explicit(&ctx->stats[i], 0, memory_order_relaxed);
+    }
+#else
+    (void) ctx;
+#endif  // MORSE_STATS
+}
+
+/**
+ * \brief Prepare a queue for use by morse_ctx_enqueue().
+ *
+ * The queue is used by a context once it is set as the context's
+ * queue field.
+ */
+void morse_queue_init(morse_queue *queue) {
+#if MORSE_QUEUE_SIZE > 0
+    morse_queue_init_buffer(queue, queue->storage, sizeof(queue->storage));
+#else
+    morse_queue_init_buffer(queue, NULL, 0);
+#endif  // MORSE_QUEUE_SIZE
+}
+
+/**
+ * \brief Prepare a queue for use, as morse_queue_init(), with its arena
+ * in caller-supplied memory instead of that built into the queue.
+ *
+ * mem must outlive the queue. A message takes the space given by
+ * morse_encoded_size() in the arena.
+ */
+void morse_queue_init_buffer(morse_queue *queue, uint8_t *mem, size_t size) {
+    memset(queue, 0, offsetof(morse_queue, arena));
+    queue->arena = mem;
+    queue->arena_size = size > UINT32_MAX ? UINT32_MAX : (uint32_t) size;
+}
+
+/**
+ * \brief Prepare an empty cache for use by morse_ctx_send().
+ *
+ * The cache is used by a context once it is set as the context's
+ * cache field. Messages sent from the cache are played as if encoded
+ * again, at the timing they are sent with, other than that they may
+ * not be extended by morse_ctx_append().
+ */
+void morse_cache_init(morse_cache *cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+/**
+ * \brief Queue a string to be played by a context.
+ *
+ * Unlike morse_ctx_send(), which replaces a message that has not yet
+ * started, each queued message is kept until it has been played, so
+ * bursts of messages can be queued without loss. Queued messages are
+ * played in order of priority, and then in the order they were
+ * queued, before streamed characters. A sent message is played ahead
+ * of queued messages of priority 0 only.
+ *
+ * Space used by a message is only reused once all messages queued
+ * before it have been played, so a message of low priority, held back
+ * by a steady supply of messages of higher priority, holds the space
+ * after it until it is played.
+ *
+ * \param plays Number of times to play the message, or 0 to repeat
+ *      it until anything else is waiting to be played, or until
+ *      morse_ctx_stop() is called.
+ * \param priority Higher priorities are played first.
+ * \param preempt Whether to cut the live message short, as
+ *      morse_ctx_interrupt() does, but without discarding anything
+ *      waiting to be played, if this message is next to play and the
+ *      live message does not have a higher priority.
+ * \return Whether the string was queued. False if the context has no
+ *      queue, if an invalid character is reached, or if the queue is
+ *      full, in which case it may be retried once messages have been
+ *      played.
+ */
+bool morse_ctx_enqueue(
+        morse_ctx *ctx,
+        const char *s,
+        uint8_t plays,
+        uint8_t priority,
+        bool preempt) {
+    morse_queue *const queue = ctx->queue;
+    if (!queue) {
+        MORSE_REPORT("Context has no queue.");
+        return false;
+    }
+    const size_t n = strlen(s);
+    if (!morse_accept(s, n, ctx->policy)) {
+        MORSE_COUNT(ctx->stats, MORSE_STAT_INVALID);
+        return false;
+    }
+    morse_queue_free(queue);
+    const uint16_t head =
+            atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if ((uint16_t) (head - queue->tail) == MORSE_QUEUE_LEN) {
+        MORSE_COUNT(ctx->stats, MORSE_STAT_QUEUE_FULL);
+        return false;
+    }
+    uint32_t offset;
+    const uint32_t size = morse_queue_encode(
+            queue, s, n, ctx->format, morse_invalid_glyph(ctx->policy),
+            &offset);
+    if (!size) {
+        MORSE_COUNT(ctx->stats, MORSE_STAT_QUEUE_FULL);
+        return false;
+    }
+    MORSE_COUNT(ctx->stats, MORSE_STAT_ENCODES);
+    queue->arena_head = offset + size;
+
+    morse_queue_entry *const entry = &queue->entries[head % MORSE_QUEUE_LEN];
+    entry->format = ctx->format;
+    entry->priority = priority;
+    entry->plays = plays;
+    entry->preempt = preempt;
+    entry->timing = ctx->timing;
+    entry->seq = head;
+    entry->offset = offset;
+    entry->size = size;
+    atomic_store_explicit(
+            &entry->state, MORSE_SLOT_READY, memory_order_release);
+    atomic_store_explicit(
+            &queue->head, (uint16_t) (head + 1), memory_order_release);
+    if (preempt) {
+        const uint8_t seq = atomic_load_explicit(
+                &queue->preempt_seq, memory_order_relaxed);
+        atomic_store_explicit(&queue->preempt_seq, (uint8_t) (seq + 1),
+                memory_order_release);
+    }
+    return true;
+}
+
+/**
+ * \brief Get timing for a speed in words per minute.
+ *
+ * Uses the length of "PARIS " as a word: 50 dot durations.
+ *
+ * \param wpm Speed of characters.
+ * \param farnsworth_wpm Overall speed, to which the gaps between
+ *      characters and words are stretched. Ignored if zero or not
+ *      below wpm.
+ */
+morse_timing morse_wpm(uint32_t wpm, uint32_t farnsworth_wpm) {
+    if (!wpm) wpm = 1;
+    const uint32_t dot_ms = 1200 / wpm;
+    if (!farnsworth_wpm || farnsworth_wpm >= wpm) {
+        return (morse_timing) {dot_ms, dot_ms};
+    }
+    // Of the 50 dot durations of a word, 19 are gaps between characters
+    // and words, which take whatever time the characters leave.
+    const uint32_t word_ms = 60000 / farnsworth_wpm;
+    const uint32_t gap_ms = (word_ms - 31 * dot_ms) / 19;
+    return (morse_timing) {dot_ms, gap_ms > UINT16_MAX ? UINT16_MAX : gap_ms};
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Get the size in bytes of a string once encoded, without
+ * encoding it.
+ *
+ * This is the smallest buffer size with which the string can be
+ * passed to morse_encode() or morse_ctx_send() in the passed format,
+ * so that buffers can be allocated once for the longest message.
+ *
+ * \return Size in bytes, or zero if s holds a character without a
+ *      pattern and policy is MORSE_POLICY_ERROR.
+ */
+uint32_t morse_encoded_size(
+        const char *s, const morse_format format, const morse_policy policy) {
+    const size_t n = strlen(s);
+    if (policy == MORSE_POLICY_ERROR && !morse_valid(s, n)) return 0;
+    return morse_size_valid(s, n, format, morse_invalid_glyph(policy));
+}
+
+/**
+ * \brief Encode a string into buf, prefixed by its length in bits.
+ *
+ * This is the layout of MORSE_FORMAT_BITS, which may be played with
+ * morse_ctx_send_encoded(), or read with morse_len(), morse_bit() and
+ * morse_edge(), for example to render it for hardware.
+ *
+ * \param size Size of buf in bytes.
+ * \return Whether s was encoded. If not, the length in buf is zero.
+ */
+bool morse_encode(uint8_t *buf, const char *s, const uint32_t size) {
+    const size_t n = strlen(s);
+    if (size >= 4 && !morse_valid(s, n)) {
+        morse_report_invalid(s);
+        morse_encode_len(buf, 0);
+        MORSE_COUNT_SHARED(MORSE_STAT_INVALID);
+        return false;
+    }
+    const bool encoded =
+            morse_encode_valid(
+                    buf, s, n, size, morse_no_glyph, NULL, NULL, false);
+    MORSE_COUNT_SHARED(encoded ? MORSE_STAT_ENCODES : MORSE_STAT_TOO_LONG);
+    return encoded;
+}
+
+/**
+ * \brief Encode many strings independently, as morse_encode().
+ *
+ * Nothing is shared between strings, and nothing is reported on
+ * stderr, so batches may be encoded by many threads at once, as long
+ * as their buffers differ. Characters are checked 8 at a time before
+ * each string is encoded.
+ *
+ * \param bufs Array of n buffers, each of size bytes.
+ * \param s Array of n strings, encoded into the buffers in order. The
+ *      length in the buffer of each string that cannot be encoded is
+ *      set to zero.
+ * \return Number of strings encoded.
+ */
+size_t morse_encode_batch(
+        uint8_t *const *bufs,
+        const char *const *s,
+        size_t n,
+        const uint32_t size) {
+    if (size < 4) return 0;
+    size_t encoded = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const size_t len = strlen(s[i]);
+        if (!morse_valid(s[i], len)) {
+            morse_encode_len(bufs[i], 0);
+            MORSE_COUNT_SHARED(MORSE_STAT_INVALID);
+        } else if (morse_encode_valid(
+                bufs[i], s[i], len, size, morse_no_glyph, NULL, NULL, true)) {
+            ++encoded;
+        } else {
+            MORSE_COUNT_SHARED(MORSE_STAT_TOO_LONG);
+        }
+    }
+    MORSE_COUNT_SHARED_N(MORSE_STAT_ENCODES, encoded);
+    return encoded;
+}
+
+/**
+ * \brief Measure the n characters of a piece of a text as sent under
+ * policy, both as if started outside of a prosign and within one.
+ *
+ * Until its first prosign delimiter, the piece is looked up in both
+ * states, after which they agree. So a delimiter early in each piece
+ * keeps this to one lookup per character.
+ *
+ * \param s Piece of the text, which need not be terminated.
+ */
+void morse_piece_measure(
+        morse_piece *piece,
+        const char *s,
+        const size_t n,
+        const morse_policy policy) {
+    const morse_glyph invalid = morse_invalid_glyph(policy);
+    uint8_t join = MORSE_JOIN_NONE;
+    uint8_t alt = MORSE_JOIN_FIRST;
+    uint64_t bits = 0;
+    uint64_t alt_bits = 0;
+    uint64_t without = 0;
+    size_t i = 0;
+    for (; i < n && join != alt; ++i) {
+        const uint8_t c = (uint8_t) s[i];
+        bits += morse_lookup(c, invalid, &join).len;
+        alt_bits += morse_lookup(c, invalid, &alt).len;
+        without += !glyphs[c].len & !glyphs[c].prosign;
+    }
+    const bool delimited = join == alt;
+    for (; i < n; ++i) {
+        const uint8_t c = (uint8_t) s[i];
+        const uint8_t len = morse_lookup(c, invalid, &join).len;
+        bits += len;
+        alt_bits += len;
+        without += !glyphs[c].len & !glyphs[c].prosign;
+    }
+    *piece = (morse_piece) {
+            bits, alt_bits, without, delimited, join != MORSE_JOIN_NONE};
+}
+
+/**
+ * \brief Encode the n characters of a piece of a text into buf from
+ * bit index bit, once measured, with the bits of the pieces before it.
+ *
+ * The piece writes no byte that it shares with another, so that the
+ * pieces of a text may be encoded by many threads at once. Its bits in
+ * the byte holding bit are passed back in edges[0], and those in the
+ * byte holding its end in edges[1], to be or'd into buf by the caller
+ * once all are written, as by morse_pipeline_encode(). Neither length
+ * nor padding is written, see morse_piece_finish().
+ *
+ * \param bit Bit index after the length bytes, as for morse_bit().
+ * \param in_prosign Whether the piece starts within a prosign.
+ */
+void morse_piece_encode(
+        uint8_t *buf,
+        const uint32_t bit,
+        const char *s,
+        const size_t n,
+        const morse_policy policy,
+        const bool in_prosign,
+        uint8_t edges[2]) {
+    const morse_glyph invalid = morse_invalid_glyph(policy);
+    uint8_t join = in_prosign ? MORSE_JOIN_FIRST : MORSE_JOIN_NONE;
+    uint8_t *out = buf + 4 + bit / 8;
+    uint64_t acc = 0;
+    uint32_t acc_len = bit % 8;
+    size_t i = 0;
+    edges[0] = 0;
+    edges[1] = 0;
+    if (acc_len) {
+        while (i < n && acc_len < 8) {
+            const morse_glyph glyph =
+                    morse_lookup((uint8_t) s[i++], invalid, &join);
+            acc |= (uint64_t) glyph.bits << acc_len;
+            acc_len += glyph.len;
+        }
+        edges[0] = (uint8_t) acc;
+        if (acc_len < 8) return;  // All in the first byte.
+        acc >>= 8;
+        acc_len -= 8;
+        ++out;
+    }
+    for (; i < n; ++i) {
+        const morse_glyph glyph = morse_lookup((uint8_t) s[i], invalid, &join);
+        acc |= (uint64_t) glyph.bits << acc_len;
+        acc_len += glyph.len;
+        if (acc_len >= 32) {
+            morse_encode_word(out, (uint32_t) acc);
+            out += 4;
+            acc >>= 32;
+            acc_len -= 32;
+        }
+    }
+    for (; acc_len >= 8; acc_len -= 8) {
+        *out++ = (uint8_t) acc;
+        acc >>= 8;
+    }
+    edges[1] = (uint8_t) acc;
+}
+
+/**
+ * \brief Complete a message of bits bits written by
+ * morse_piece_encode(), with its padding and length, once the byte
+ * holding its end is set.
+ *
+ * \param buf NULL to only get the size.
+ * \param size Size of buf in bytes.
+ * \return Size of the encoded message in bytes, as morse_encoded_size(),
+ *      or zero if it does not fit.
+ */
+uint32_t morse_piece_finish(
+        uint8_t *buf, const uint32_t bits, const uint32_t size) {
+    const uint32_t padding = 4 * glyphs[' '].len;
+    const uint64_t len = (uint64_t) bits + padding;
+    const uint64_t encoded = 4 + (len + 7) / 8;
+    if (size < 4 || len > UINT32_MAX || encoded > size) {
+        MORSE_REPORT("Buffer size limit reached.");
+        if (size >= 4) morse_encode_len(buf, 0);
+        return 0;
+    }
+    if (!buf) return (uint32_t) encoded;
+    memset(buf + 4 + (bits + 7) / 8, 0, encoded - 4 - (bits + 7) / 8);
+    morse_encode_len(buf, (uint32_t) len);
+    return (uint32_t) encoded;
+}
+
+/**
+ * \brief Get length in bits / dot durations of encoded morse message.
+ */
+uint32_t morse_len(const uint8_t *buf) {
+    return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+/**
+ * \brief Get signal of encoded message at dot duration bit_index.
+ */
+bool morse_bit(const uint8_t *buf, const uint32_t bit_index) {
+    const uint32_t i = bit_index + 32;
+    return (buf[i / 8] >> (i % 8)) & 1;
+}
+
+/**
+ * \brief Get index of the first bit after bit_index with a different
+ * value, or len if the value does not change before the end of buf.
+ *
+ * Bits are read a word at a time. In MORSE_FORMAT_BITS, bit i is bit
+ * i % 32 of the little endian word at byte 4 + i / 32 * 4, which is
+ * aligned if buf is, so each step passes the rest of a run within the
+ * word from the byte of i, which is at least 25 bits, and the padding
+ * at the end of a message takes one or two.
+ */
+uint32_t morse_edge(
+        const uint8_t *buf, const uint32_t bit_index, const uint32_t len) {
+    const bool value = morse_bit(buf, bit_index);
+    uint32_t i = bit_index + 1;
+    // Most runs are of one dot duration, and take a single byte.
+    if (i >= len || morse_bit(buf, i) != value) return i;
+    while (i < len) {
+        const uint32_t edge = morse_word_edge(
+                morse_load_word(buf, i - i % 8, len), value, i % 8);
+        if (edge < 32) {
+            i += edge - i % 8;
+            return i < len ? i : len;
+        }
+        i += 32 - i % 8;
+    }
+    return len;
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Make the next message or streamed character live.
+ *
+ * Queued messages of raised priority go first, then a sent message,
+ * then other queued messages, and then streamed characters. If none
+ * is waiting, the live message is left empty. Only called by the
+ * consumer.
+ */
+static void morse_switch_buf(morse_ctx *ctx) {
+    morse_queue_release(ctx);
+    ctx->loop_len = 0;
+    ctx->live_priority = 0;
+    ctx->plays = 0;
+    const uint8_t entry = morse_queue_best(ctx->queue);
+    if (entry != MORSE_NO_ENTRY && ctx->queue->entries[entry].priority) {
+        morse_queue_take(ctx, entry);
+        return;
+    }
+    uint8_t state = MORSE_SLOT_READY;
+    if (atomic_compare_exchange_strong_explicit(
+            &ctx->pending, &state, MORSE_SLOT_TAKING,
+            memory_order_acquire, memory_order_relaxed)) {
+        ctx->live_buf = ctx->next_buf;
+        ctx->live_index = ctx->next_index;
+        ctx->live_len = morse_len(ctx->live_buf);
+        ctx->live_format = ctx->next_format;
+        ctx->live_timing = ctx->next_timing;
+        ctx->run = morse_run_start;
+        atomic_store_explicit(
+                &ctx->repeat, ctx->repeat_next, memory_order_relaxed);
+        atomic_store_explicit(
+                &ctx->pending, MORSE_SLOT_FREE, memory_order_release);
+        return;
+    }
+    if (entry != MORSE_NO_ENTRY) {
+        morse_queue_take(ctx, entry);
+        return;
+    }
+    uint16_t tail =
+            atomic_load_explicit(&ctx->stream_tail, memory_order_relaxed);
+    const uint16_t head =
+            atomic_load_explicit(&ctx->stream_head, memory_order_acquire);
+    if (tail != head) {
+        // Prosign delimiters are taken along with the next character.
+        morse_glyph glyph = morse_no_glyph;
+        while (!glyph.len && tail != head) {
+            glyph = morse_lookup(
+                    (uint8_t) ctx->stream[tail % MORSE_STREAM_LEN],
+                    morse_no_glyph, &ctx->stream_join);
+            ++tail;
+        }
+        atomic_store_explicit(&ctx->stream_tail, tail, memory_order_release);
+        if (!glyph.len) {
+            ctx->live_len = 0;
+            return;
+        }
+        ctx->glyph = glyph.bits;
+        ctx->live_len = glyph.len;
+        ctx->live_format = MORSE_FORMAT_STREAM;
+        ctx->live_timing = atomic_load_explicit(
+                &ctx->stream_timing, memory_order_relaxed);
+        atomic_store_explicit(&ctx->repeat, false, memory_order_relaxed);
+        return;
+    }
+    ctx->live_len = 0;
+}
+
+/**
+ * \brief Start the run of the live message at dot duration pos, and
+ * work out when it ends.
+ *
+ * On runs, and off runs of one dot duration, are timed by dot_ms, and
+ * longer off runs, which are gaps between characters, by gap_ms.
+ */
+static void morse_start_run(morse_ctx *ctx, const uint32_t pos) {
+    ctx->pos = pos;
+    if (pos >= ctx->live_len) {
+        ctx->edge = pos;
+        return;
+    }
+    if (ctx->loop_len && morse_loop_start(ctx, pos)) return;
+    const uint32_t edge = morse_live_edge(ctx, &ctx->run, pos);
+    const uint32_t units = edge - pos;
+    const bool value = morse_live_bit(ctx, &ctx->run, pos);
+    const uint32_t unit_ms = value || units == 1 ?
+            ctx->live_timing.dot_ms : ctx->live_timing.gap_ms;
+    ctx->edge = edge;
+    ctx->edge_time += units * unit_ms;
+    ctx->run_level = value;
+}
+
+/**
+ * \brief Time each run of the live message into its loop cache, if it
+ * fits, so that repeats do not have to.
+ */
+static void morse_loop_compile(morse_ctx *ctx) {
+    if (ctx->live_format == MORSE_FORMAT_STREAM) return;
+    uint32_t n = 0;
+    ctx->edge = 0;
+    ctx->edge_time = 0;
+    while (ctx->edge < ctx->live_len) {
+        if (n == ctx->loop_size) return;
+        morse_start_run(ctx, ctx->edge);
+        if (!n) ctx->loop_level = ctx->run_level;
+        ctx->loop[n++] = (morse_loop_edge) {ctx->edge, ctx->edge_time};
+    }
+    ctx->loop_len = n;
+    ctx->loop_run = 0;
+    ctx->loop_timing = ctx->live_timing;
+}
+
+/**
+ * \brief Start the run at pos from the loop cache, as morse_start_run().
+ *
+ * \return false if pos does not start a run, or the cache is not
+ *      usable.
+ */
+static bool morse_loop_start(morse_ctx *ctx, const uint32_t pos) {
+    if (!morse_loop_usable(ctx)) return false;
+    const morse_loop_edge *const loop = ctx->loop;
+    // Runs are mostly started in order, so the next is tried first.
+    uint32_t i = pos ? ctx->loop_run + 1 : 0;
+    if (pos && (i >= ctx->loop_len || loop[i - 1].unit != pos)) {
+        uint32_t lo = 0;
+        uint32_t hi = ctx->loop_len;
+        while (lo < hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            if (loop[mid].unit <= pos) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (!lo || loop[lo - 1].unit != pos) return false;
+        i = lo;
+    }
+    ctx->loop_run = i;
+    ctx->edge = loop[i].unit;
+    ctx->edge_time += loop[i].time_ms - (i ? loop[i - 1].time_ms : 0);
+    ctx->run_level = ctx->loop_level ^ (i & 1);
+    return true;
+}
+
+/**
+ * \brief Whether the live message is cached, at its live timing,
+ * dropping the cache if live_timing has been changed since.
+ */
+static bool morse_loop_usable(morse_ctx *ctx) {
+    if (!ctx->loop_len) return false;
+    if (ctx->loop_timing.dot_ms != ctx->live_timing.dot_ms ||
+            ctx->loop_timing.gap_ms != ctx->live_timing.gap_ms) {
+        ctx->loop_len = 0;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Whether the runs of the live message may be skipped over, as
+ * it is cached, and no callback wants to see them.
+ */
+static bool morse_loop_skippable(morse_ctx *ctx) {
+#if MORSE_TRACE
+    if (ctx->trace_cb) return false;
+#endif  // MORSE_TRACE
+    return !ctx->edge_cb && morse_loop_usable(ctx);
+}
+
+/**
+ * \brief Move straight to the run of the cached live message being
+ * played at elapsed_time, or to its end if that is past.
+ */
+static void morse_loop_seek(morse_ctx *ctx) {
+    const morse_loop_edge *const loop = ctx->loop;
+    uint32_t lo = 0;
+    uint32_t hi = ctx->loop_len;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (loop[mid].time_ms <= ctx->elapsed_time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    ctx->edge_time = lo ? loop[lo - 1].time_ms : 0;
+    morse_start_run(ctx, lo ? loop[lo - 1].unit : 0);
+}
+
+/**
+ * \brief Take ownership of the next buffer of ctx for the producer.
+ *
+ * A message that has not yet been taken by the consumer is withdrawn,
+ * so that it can be replaced. Otherwise, the last message handed over
+ * is noted as played, so that its buffer is not reused. If the
+ * consumer is taking a message at the same time, waits for it to
+ * finish, which takes a few instructions. If the consumer runs in an
+ * interrupt that preempts the producer, it can never be observed doing
+ * so.
+ */
+static void morse_claim_next(morse_ctx *ctx) {
+    uint8_t state = MORSE_SLOT_READY;
+    while (!atomic_compare_exchange_weak_explicit(
+            &ctx->pending, &state, MORSE_SLOT_FREE,
+            memory_order_acquire, memory_order_acquire)) {
+        if (state == MORSE_SLOT_FREE) {
+            // The last message handed over was taken, and may be live.
+            if (ctx->next_buf) ctx->played_buf = ctx->next_buf;
+            return;
+        }
+        state = MORSE_SLOT_READY;
+    }
+    ctx->next_buf = NULL;  // Withdrawn before it was taken.
+}
+
+/**
+ * \brief Hand over the message of len bits in buf built by
+ * morse_ctx_append(), withdrawn by morse_claim_next() if extended.
+ */
+static void morse_publish_append(
+        morse_ctx *ctx,
+        uint8_t *buf,
+        const uint32_t len,
+        const bool extended) {
+    morse_encode_len(buf, len);
+    if (!extended) {
+        ctx->next_timing = ctx->timing;
+        ctx->repeat_next = false;
+    }
+    ctx->append_buf = buf;
+    ctx->next_buf = buf;
+    ctx->next_index = NULL;
+    ctx->next_format = MORSE_FORMAT_BITS;
+    atomic_store_explicit(&ctx->repeat, false, memory_order_relaxed);
+    atomic_store_explicit(
+            &ctx->pending, MORSE_SLOT_READY, memory_order_release);
+}
+
+/**
+ * \brief Apply a morse_ctx_interrupt() call made since the last update.
+ *
+ * Only called by the consumer.
+ */
+static void morse_take_interrupt(morse_ctx *ctx) {
+    const uint8_t seq =
+            atomic_load_explicit(&ctx->interrupt_seq, memory_order_acquire);
+    if (seq == ctx->interrupt_ack) return;
+    ctx->interrupt_ack = seq;
+    morse_cut(ctx);
+    const uint16_t drop =
+            atomic_load_explicit(&ctx->stream_drop, memory_order_relaxed);
+    const uint16_t tail =
+            atomic_load_explicit(&ctx->stream_tail, memory_order_relaxed);
+    if ((int16_t) (drop - tail) > 0) {
+        atomic_store_explicit(&ctx->stream_tail, drop, memory_order_release);
+    }
+}
+
+/**
+ * \brief Cut the live message short, if a message queued since the
+ * last update preempts it.
+ *
+ * Only called by the consumer.
+ */
+static void morse_take_preempt(morse_ctx *ctx) {
+    morse_queue *const queue = ctx->queue;
+    if (!queue) return;
+    const uint8_t seq =
+            atomic_load_explicit(&queue->preempt_seq, memory_order_acquire);
+    if (seq == queue->preempt_ack) return;
+    queue->preempt_ack = seq;
+    const uint8_t entry = morse_queue_best(queue);
+    if (entry == MORSE_NO_ENTRY || !queue->entries[entry].preempt) return;
+    if (ctx->live_len && queue->entries[entry].priority < ctx->live_priority) {
+        return;
+    }
+    morse_cut(ctx);
+}
+
+/**
+ * \brief Stop the live message immediately, so that whatever is
+ * waiting starts on the next update.
+ */
+static void morse_cut(morse_ctx *ctx) {
+    if (ctx->live_len) MORSE_TRACE_EVENT(ctx, MORSE_TRACE_END);
+    morse_queue_release(ctx);
+    ctx->live_len = 0;
+    ctx->loop_len = 0;
+    ctx->elapsed_time = 0;
+    ctx->edge_time = 0;
+    morse_start_run(ctx, 0);
+}
+
+/**
+ * \brief Whether the live message should be played again once it is
+ * complete, counting down its remaining plays if it has a count.
+ */
+static bool morse_replay(morse_ctx *ctx) {
+    if (!atomic_load_explicit(&ctx->repeat, memory_order_relaxed)) {
+        return false;
+    }
+    if (!ctx->plays) return !morse_queued(ctx);
+    return --ctx->plays != 0;
+}
+
+/**
+ * \brief Whether a message or streamed characters are waiting to be
+ * played by ctx.
+ */
+static bool morse_queued(const morse_ctx *ctx) {
+    const uint8_t state =
+            atomic_load_explicit(&ctx->pending, memory_order_relaxed);
+    const uint16_t head =
+            atomic_load_explicit(&ctx->stream_head, memory_order_relaxed);
+    const uint16_t tail =
+            atomic_load_explicit(&ctx->stream_tail, memory_order_relaxed);
+    const morse_queue *const queue = ctx->queue;
+    return state == MORSE_SLOT_READY || head != tail || (queue &&
+            atomic_load_explicit(&queue->head, memory_order_relaxed)
+                    != queue->taken);
+}
+
+/**
+ * \brief Get index of the queued message to be played next: the
+ * oldest of the highest priority.
+ *
+ * \return MORSE_NO_ENTRY if no message is queued.
+ */
+static uint8_t morse_queue_best(const morse_queue *queue) {
+    uint8_t best = MORSE_NO_ENTRY;
+    if (!queue || atomic_load_explicit(&queue->head, memory_order_acquire)
+            == queue->taken) {
+        return best;
+    }
+    for (uint8_t i = 0; i < MORSE_QUEUE_LEN; ++i) {
+        const morse_queue_entry *const entry = &queue->entries[i];
+        if (atomic_load_explicit(&entry->state, memory_order_acquire)
+                != MORSE_SLOT_READY) {
+            continue;
+        }
+        if (best == MORSE_NO_ENTRY) {
+            best = i;
+            continue;
+        }
+        const morse_queue_entry *const other = &queue->entries[best];
+        if (entry->priority > other->priority ||
+                (entry->priority == other->priority &&
+                 (int16_t) (entry->seq - other->seq) < 0)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * \brief Make a queued message live.
+ */
+static void morse_queue_take(morse_ctx *ctx, const uint8_t index) {
+    morse_queue *const queue = ctx->queue;
+    morse_queue_entry *const entry = &queue->entries[index];
+    atomic_store_explicit(
+            &entry->state, MORSE_SLOT_TAKING, memory_order_relaxed);
+    ++queue->taken;
+    ctx->live_buf = queue->arena + entry->offset;
+    ctx->live_index = NULL;
+    ctx->live_len = morse_len(ctx->live_buf);
+    ctx->live_format = entry->format;
+    ctx->live_timing = entry->timing;
+    ctx->run = morse_run_start;
+    ctx->live_entry = index;
+    ctx->live_priority = entry->priority;
+    ctx->plays = entry->plays;
+    atomic_store_explicit(
+            &ctx->repeat, entry->plays != 1, memory_order_relaxed);
+}
+
+/**
+ * \brief Hand the live message back to the producer, if it was queued.
+ *
+ * Only called by the consumer, once it no longer reads the message.
+ */
+static void morse_queue_release(morse_ctx *ctx) {
+    if (ctx->live_entry == MORSE_NO_ENTRY) return;
+    atomic_store_explicit(
+            &ctx->queue->entries[ctx->live_entry].state,
+            MORSE_SLOT_DONE,
+            memory_order_release);
+    ctx->live_entry = MORSE_NO_ENTRY;
+}
+
+/**
+ * \brief Free entries of played messages, oldest first, along with
+ * their space in the arena.
+ *
+ * Only called by the producer.
+ */
+static void morse_queue_free(morse_queue *queue) {
+    const uint16_t head =
+            atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (; queue->tail != head; ++queue->tail) {
+        morse_queue_entry *const entry =
+                &queue->entries[queue->tail % MORSE_QUEUE_LEN];
+        if (atomic_load_explicit(&entry->state, memory_order_acquire)
+                != MORSE_SLOT_DONE) {
+            break;
+        }
+        atomic_store_explicit(
+                &entry->state, MORSE_SLOT_FREE, memory_order_relaxed);
+    }
+    if (queue->tail == head) {
+        queue->arena_head = 0;
+        queue->arena_tail = 0;
+    } else {
+        queue->arena_tail =
+                queue->entries[queue->tail % MORSE_QUEUE_LEN].offset;
+    }
+}
+
+/**
+ * \brief Encode the n accepted characters of s into free space in the
+ * arena of queue.
+ *
+ * Messages are placed in the arena as in a ring buffer. A message that
+ * does not fit before the end of the arena is placed at its start.
+ *
+ * \param offset Set to the offset of the message in the arena.
+ * \return Size of the message, or zero if there is not enough space.
+ */
+static uint32_t morse_queue_encode(
+        morse_queue *queue,
+        const char *s,
+        const size_t n,
+        const uint8_t format,
+        const morse_glyph invalid,
+        uint32_t *offset) {
+    const uint32_t size = morse_size_valid(s, n, format, invalid);
+    if (!size) return 0;
+    const uint32_t head = queue->arena_head;
+    const uint32_t tail = queue->arena_tail;
+    const bool empty = queue->tail ==
+            atomic_load_explicit(&queue->head, memory_order_relaxed);
+    // Messages never fill the space up to tail, so that head only
+    // equals tail when the queue is empty.
+    if (empty || head >= tail) {
+        if (size <= queue->arena_size - head) {
+            *offset = head;
+        } else if (empty ? size <= queue->arena_size : size < tail) {
+            *offset = 0;
+        } else {
+            return 0;
+        }
+    } else if (size < tail - head) {
+        *offset = head;
+    } else {
+        return 0;
+    }
+    return morse_encode_format(
+            queue->arena + *offset, s, n, size, format, invalid, NULL, NULL,
+            true);
+}
+
+/**
+ * \brief Hash the n characters of s, as sent in format under policy,
+ * with FNV-1a.
+ *
+ * \return The hash, which is never 0.
+ */
+static uint32_t morse_cache_hash(
+        const char *s,
+        const size_t n,
+        const uint8_t format,
+        const uint8_t policy) {
+    uint32_t hash = 2166136261u ^ format ^ (uint32_t) policy << 8;
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= (uint8_t) s[i];
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/**
+ * \brief Find the message of the cache of a context holding the n
+ * characters of s, as sent by the context, and mark it as used.
+ *
+ * \return The cached message, or NULL if there is none.
+ */
+static morse_cache_entry *morse_cache_find(
+        morse_ctx *ctx, const char *s, const size_t n, const uint32_t hash) {
+    morse_cache *const cache = ctx->cache;
+    ++cache->lookups;
+    for (size_t i = 0; i < MORSE_CACHE_LEN; ++i) {
+        morse_cache_entry *const entry = &cache->entries[i];
+        if (entry->used && entry->hash == hash && entry->n == n
+                && entry->format == ctx->format
+                && entry->policy == ctx->policy
+                && !memcmp(entry->text, s, n)) {
+            entry->used = cache->lookups ? cache->lookups : 1;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Encode the n characters of s, as sent by a context, in place
+ * of the least recently used message of its cache.
+ *
+ * The message the consumer last took is never replaced, as it may
+ * still be playing. The one withdrawn from it, if any, may be.
+ *
+ * \return The cached message, or NULL if s does not fit in one.
+ */
+static morse_cache_entry *morse_cache_fill(
+        morse_ctx *ctx, const char *s, const size_t n, const uint32_t hash) {
+    morse_cache *const cache = ctx->cache;
+    morse_cache_entry *victim = NULL;
+    uint32_t oldest = 0;
+    for (size_t i = 0; i < MORSE_CACHE_LEN; ++i) {
+        morse_cache_entry *const entry = &cache->entries[i];
+        if (entry->buf == ctx->played_buf) continue;
+        // Ages are taken from lookups, so that they survive it wrapping.
+        const uint32_t age = entry->used ? cache->lookups - entry->used
+                : UINT32_MAX;
+        if (!victim || age > oldest) {
+            victim = entry;
+            oldest = age;
+        }
+    }
+    if (!victim) return NULL;
+    victim->used = 0;
+    if (!morse_encode_format(
+            victim->buf, s, n, MORSE_CACHE_SIZE, ctx->format,
+            morse_invalid_glyph(ctx->policy), &victim->index, NULL, true)) {
+        return NULL;
+    }
+    victim->hash = hash;
+    victim->used = cache->lookups ? cache->lookups : 1;
+    victim->format = ctx->format;
+    victim->policy = ctx->policy;
+    victim->n = (uint8_t) n;
+    memcpy(victim->text, s, n);
+    MORSE_COUNT(ctx->stats, MORSE_STAT_ENCODES);
+    return victim;
+}
+
+/**
+ * \brief Encode the n accepted characters of s into buf in the passed
+ * format.
+ *
+ * \param invalid Pattern of characters without one.
+ * \param index Built for the message, unless NULL.
+ * \param join For MORSE_FORMAT_BITS, set to the prosign state after s
+ *      unless NULL.
+ * \return Size of the encoded message, or zero if it does not fit.
+ */
+static uint32_t morse_encode_format(
+        uint8_t *buf,
+        const char *s,
+        const size_t n,
+        const uint32_t size,
+        const uint8_t format,
+        const morse_glyph invalid,
+        morse_index *index,
+        uint8_t *join,
+        const bool quiet) {
+    if (format == MORSE_FORMAT_RUNS) {
+        return morse_encode_runs(buf, s, n, size, invalid, index, quiet);
+    }
+    return morse_encode_valid(buf, s, n, size, invalid, index, join, quiet);
+}
+
+/**
+ * \brief Get the size in bytes of the n accepted characters of s once
+ * encoded in the passed format, or zero if it exceeds 4GB.
+ */
+static uint32_t morse_size_valid(
+        const char *s,
+        const size_t n,
+        const uint8_t format,
+        const morse_glyph invalid) {
+    if (format == MORSE_FORMAT_RUNS) {
+        // Runs are variable length, so they are counted by encoding
+        // without a buffer.
+        return morse_encode_runs(
+                NULL, s, n, UINT32_MAX, invalid, NULL, true);
+    }
+    uint64_t len = 4 * glyphs[' '].len;  // End of message padding.
+    uint8_t join = MORSE_JOIN_NONE;
+    for (size_t i = 0; i < n; ++i) {
+        len += morse_lookup((uint8_t) s[i], invalid, &join).len;
+    }
+    const uint64_t size = 4 + (len + 7) / 8;
+    return size > UINT32_MAX ? 0 : (uint32_t) size;
+}
+
+/**
+ * \brief Whether the n characters of s may be encoded under policy,
+ * reporting the first one without a pattern on stderr if not.
+ *
+ * Only MORSE_POLICY_ERROR needs a pass over s before it is encoded.
+ */
+static bool morse_accept(const char *s, const size_t n, const uint8_t policy) {
+    if (policy != MORSE_POLICY_ERROR || morse_valid(s, n)) return true;
+    morse_report_invalid(s);
+    return false;
+}
+
+/**
+ * \brief Get the pattern sent for characters without one under policy.
+ */
+static morse_glyph morse_invalid_glyph(const uint8_t policy) {
+    return policy == MORSE_POLICY_SUBSTITUTE ? glyphs['?'] : morse_no_glyph;
+}
+
+/**
+ * \brief Get the pattern to append for character c.
+ *
+ * Characters without one get invalid instead. The characters of a
+ * prosign, between '<' and '>', are joined by dropping the gap before
+ * each but the first, and the delimiters themselves have an empty
+ * pattern. A space within a prosign is sent as usual, and starts a
+ * new one after it.
+ *
+ * \param join State of prosign joining, which starts at
+ *      MORSE_JOIN_NONE for each message.
+ */
+static inline morse_glyph morse_lookup(
+        const uint8_t c, const morse_glyph invalid, uint8_t *join) {
+    morse_glyph glyph = glyphs[c];
+    if (!glyph.len) {
+        if (glyph.prosign) {
+            *join = glyph.prosign == MORSE_PROSIGN_START ?
+                    MORSE_JOIN_FIRST : MORSE_JOIN_NONE;
+            return glyph;
+        }
+        glyph = invalid;
+        if (!glyph.len) return glyph;
+    }
+    // Characters start with 2 empty dot durations, which leave the gap
+    // between elements when dropped. Done without branches, as it runs
+    // for every character.
+    const bool space = !glyph.bits;
+    const uint8_t drop = space ? 0 : *join & MORSE_JOIN_NEXT;
+    glyph.bits >>= drop;
+    glyph.len -= drop;
+    if (*join) *join = space ? MORSE_JOIN_FIRST : MORSE_JOIN_NEXT;
+    return glyph;
+}
+
+/**
+ * \brief Report the first invalid character of s on stderr.
+ */
+static void morse_report_invalid(const char *s) {
+    const char *c = s;
+    while (glyphs[(uint8_t) *c].len || glyphs[(uint8_t) *c].prosign) ++c;
+    MORSE_REPORT("Invalid char: %c", *c);
+}
+
+/**
+ * \brief Pass value to edge_cb of ctx if it differs from the last one.
+ */
+static void morse_set_level(
+        morse_ctx *ctx, const bool value, const uint32_t offset_ms) {
+    if (value == ctx->level) {
+        MORSE_COUNT(ctx->stats, MORSE_STAT_SUPPRESSED);
+        return;
+    }
+    ctx->level = value;
+    MORSE_COUNT(ctx->stats, MORSE_STAT_CALLBACKS);
+    ctx->edge_cb(ctx, value, offset_ms);
+}
+
+/**
+ * \brief Point the callbacks of the default context at the global ones.
+ */
+static void morse_default_callbacks(void) {
+    morse_default_ctx.cb = morse_default_cb;
+    morse_default_ctx.edge_cb = morse_edge_cb ? morse_default_edge_cb : NULL;
+#if MORSE_TRACE
+    morse_default_ctx.trace_cb =
+            morse_trace_cb ? morse_default_trace_cb : NULL;
+#endif  // MORSE_TRACE
+}
+
+static void morse_default_cb(morse_ctx *ctx, bool value) {
+    (void) ctx;
+    morse_cb(value);
+}
+
+static void morse_default_edge_cb(
+        morse_ctx *ctx, bool value, uint32_t offset_ms) {
+    (void) ctx;
+    morse_edge_cb(value, offset_ms);
+}
+
+#if MORSE_TRACE
+static void morse_default_trace_cb(morse_ctx *ctx, morse_trace event) {
+    (void) ctx;
+    morse_trace_cb(event);
+}
+#endif  // MORSE_TRACE
+
+#if MORSE_STATS
+/**
+ * \brief Add one to a counter that only the calling thread writes.
+ */
+static void morse_count(MORSE_ATOMIC(uint32_t) *stats, morse_stat stat) {
+    const uint32_t count =
+            atomic_load_explicit(&stats[stat], memory_order_relaxed);
+    atomic_store_explicit(&stats[stat], count + 1, memory_order_relaxed);
+}
+
+/**
+ * \brief Raise a counter that only the calling thread writes to value,
+ * if it is lower.
+ */
+static void morse_count_max(
+        MORSE_ATOMIC(uint32_t) *stats,
+        const morse_stat stat,
+        const uint32_t value) {
+    if (value > atomic_load_explicit(&stats[stat], memory_order_relaxed)) {
+        atomic_store_explicit(&stats[stat], value, memory_order_relaxed);
+    }
+}
+#endif  // MORSE_STATS
+
+/**
+ * \brief Get signal of live message of ctx at dot duration i.
+ *
+ * \param run Cursor used to find i if the live message is run length
+ *      encoded. Seeking forward from the cursor's position is cheap.
+ */
+static bool morse_live_bit(
+        const morse_ctx *ctx, morse_run_cursor *run, const uint32_t i) {
+    if (ctx->live_format == MORSE_FORMAT_BITS) {
+        return morse_bit(ctx->live_buf, i);
+    } else if (ctx->live_format == MORSE_FORMAT_STREAM) {
+        return (ctx->glyph >> i) & 1;
+    }
+    morse_run_seek(ctx->live_buf, run, i);
+    return run->level;
+}
+
+/**
+ * \brief Get first dot duration after i at which the signal of the
+ * live message of ctx changes, or its length if it does not change.
+ */
+static uint32_t morse_live_edge(
+        const morse_ctx *ctx, morse_run_cursor *run, const uint32_t i) {
+    if (ctx->live_format == MORSE_FORMAT_BITS) {
+        return morse_edge(ctx->live_buf, i, ctx->live_len);
+    } else if (ctx->live_format == MORSE_FORMAT_STREAM) {
+        if (i + 1 >= ctx->live_len) return i + 1;
+        const uint32_t j = morse_word_edge(
+                ctx->glyph, (ctx->glyph >> i) & 1, i + 1);
+        return j < ctx->live_len ? j : ctx->live_len;
+    }
+    morse_run_seek(ctx->live_buf, run, i);
+    return run->start + run->units;
+}
+
+/**
+ * \brief Get the time taken by each dot duration of the current run of
+ * the live message, as in morse_start_run().
+ */
+static uint32_t morse_run_ms(const morse_ctx *ctx) {
+    return ctx->run_level || ctx->edge - ctx->pos == 1 ?
+            ctx->live_timing.dot_ms : ctx->live_timing.gap_ms;
+}
+
+/**
+ * \brief Whether the live message of ctx may be sought in.
+ */
+static bool morse_seekable(const morse_ctx *ctx) {
+    return ctx->live_len && ctx->live_format != MORSE_FORMAT_STREAM &&
+            ctx->live_timing.dot_ms && ctx->live_timing.gap_ms;
+}
+
+/**
+ * \brief Get the last mark of the live message at or before both unit
+ * and time_ms, or the start of the message if it has no index.
+ *
+ * \param chr If not NULL, set to the index of the character marked.
+ */
+static const morse_mark *morse_find_mark(
+        const morse_ctx *ctx,
+        const uint32_t unit,
+        const uint32_t time_ms,
+        uint32_t *chr) {
+    const morse_index *const index = ctx->live_index;
+    if (chr) *chr = 0;
+    if (!index || !index->len) return &morse_first_mark;
+    // Marks are in order of both unit and time, and the first is at 0.
+    uint32_t lo = 0;
+    uint32_t hi = index->len;
+    while (hi - lo > 1) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const morse_mark *const mark = &index->marks[mid];
+        if (mark->unit <= unit && morse_mark_time(ctx, mark) <= time_ms) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if (chr) *chr = lo << index->shift;
+    return &index->marks[lo];
+}
+
+/**
+ * \brief Get the time since the start of the live message of ctx at
+ * which a mark is reached.
+ */
+static uint32_t morse_mark_time(
+        const morse_ctx *ctx,
+        const morse_mark *mark) {
+    return (mark->unit - mark->gaps) * ctx->live_timing.dot_ms +
+            mark->gaps * ctx->live_timing.gap_ms;
+}
+
+/**
+ * \brief Move the live message of ctx to a mark.
+ *
+ * A mark is always in an off run of at least 3 dot durations, so the
+ * part of the run after it is timed as the whole run.
+ */
+static void morse_seek_mark(morse_ctx *ctx, const morse_mark *mark) {
+    ctx->run = (morse_run_cursor) {mark->run_pos, mark->run_start, 0, true};
+    ctx->edge_time = morse_mark_time(ctx, mark);
+    ctx->elapsed_time = ctx->edge_time;
+    morse_start_run(ctx, mark->unit);
+}
+
+/**
+ * \brief Move the live message of ctx to dot duration unit, at or after
+ * mark.
+ */
+static void morse_seek_unit(
+        morse_ctx *ctx, const morse_mark *mark, const uint32_t unit) {
+    morse_seek_mark(ctx, mark);
+    while (ctx->edge <= unit && ctx->edge < ctx->live_len) {
+        morse_start_run(ctx, ctx->edge);
+    }
+    ctx->elapsed_time =
+            ctx->edge_time - (ctx->edge - unit) * morse_run_ms(ctx);
+}
+
+/**
+ * \brief Get the dot duration at which the character after the one
+ * starting at unit starts, or the length of the live message if it is
+ * the last.
+ *
+ * Characters are told apart by the gaps between them, which are off
+ * runs of 3 dot durations, plus 4 for each space, or the padding at the
+ * end of the message.
+ */
+static uint32_t morse_next_char(
+        const morse_ctx *ctx, morse_run_cursor *run, const uint32_t unit) {
+    const uint32_t len = ctx->live_len;
+    const uint32_t space = glyphs[' '].len;
+    uint32_t edge = morse_live_edge(ctx, run, unit);
+    if (edge - unit >= (edge == len ? 4 * space : 3) + space) {
+        return unit + space;
+    }
+    while (edge < len) {
+        const uint32_t off = morse_live_edge(ctx, run, edge);
+        edge = morse_live_edge(ctx, run, off);
+        if (edge - off >= 3) return off;
+    }
+    return len;
+}
+
+/**
+ * \brief Get the time taken by the live message of ctx.
+ *
+ * Uses the index of the message, or otherwise plays it through, which
+ * leaves it at its end.
+ */
+static uint32_t morse_duration(morse_ctx *ctx) {
+    const morse_index *const index = ctx->live_index;
+    if (index) {
+        const morse_mark end = {ctx->live_len, index->gaps, 0, 0};
+        return morse_mark_time(ctx, &end);
+    }
+    morse_seek_mark(ctx, &morse_first_mark);
+    while (ctx->edge < ctx->live_len) morse_start_run(ctx, ctx->edge);
+    return ctx->edge_time;
+}
+
+/**
+ * \brief Start building index, unless it is NULL.
+ */
+static morse_indexer morse_index_start(morse_index *index) {
+    if (index) {
+        index->len = 0;
+        index->shift = 0;
+    }
+    return (morse_indexer) {index, 0, 0, 0};
+}
+
+/**
+ * \brief Note a glyph about to be appended at dot duration unit in the
+ * index being built.
+ *
+ * Only glyphs that start a character are marked, which leaves out the
+ * letters of a prosign after its first. Those are told apart by
+ * starting with a single empty dot duration, rather than the three of
+ * a gap between characters, which, like any gap made of spaces, are
+ * timed by gap_ms.
+ *
+ * \param run_pos Bit index of the next run written, for
+ *      MORSE_FORMAT_RUNS.
+ */
+static void morse_index_glyph(
+        morse_indexer *x,
+        const morse_glyph glyph,
+        const uint32_t unit,
+        const uint32_t run_pos) {
+    if (!glyph.len || (glyph.bits & 0x2)) return;
+    morse_index_add(
+            x->index, x->chars++,
+            (morse_mark) {unit, x->gaps + x->pending, run_pos,
+                          unit - x->pending});
+    if (glyph.bits) {
+        x->gaps += x->pending + 3;
+        x->pending = 0;
+    } else {
+        x->pending += glyph.len;  // A space.
+    }
+}
+
+/**
+ * \brief Finish the index being built, once the padding at the end of
+ * the message is appended.
+ */
+static void morse_index_end(morse_indexer *x) {
+    x->index->gaps = x->gaps + x->pending + 4 * glyphs[' '].len;
+}
+
+/**
+ * \brief Add the mark of character chr to index, if it is due one.
+ *
+ * Once index is full, every other mark is dropped, and characters are
+ * marked half as often.
+ */
+static void morse_index_add(
+        morse_index *index,
+        const uint32_t chr,
+        const morse_mark mark) {
+    if (chr & ((1u << index->shift) - 1)) return;
+    if (index->len == MORSE_INDEX_LEN) {
+        for (uint32_t i = 0; i < MORSE_INDEX_LEN / 2; ++i) {
+            index->marks[i] = index->marks[2 * i];
+        }
+        index->len = MORSE_INDEX_LEN / 2;
+        ++index->shift;
+        if (chr & ((1u << index->shift) - 1)) return;
+    }
+    index->marks[index->len++] = mark;
+}
+
+/**
+ * \brief Encode the n characters of s into buf, once they are known
+ * to be valid, or to be sent as invalid if they have no pattern.
+ *
+ * \param join Set to the prosign state after s, unless NULL.
+ * \return Size of the encoded message in bytes, or zero if it does not
+ *      fit.
+ */
+static uint32_t morse_encode_valid(
+        uint8_t *buf,
+        const char *s,
+        const size_t n,
+        const uint32_t size,
+        const morse_glyph invalid,
+        morse_index *index,
+        uint8_t *join,
+        const bool quiet) {
+    morse_writer w;
+    if (!morse_writer_init(&w, buf, size, quiet)) return 0;
+    morse_indexer x = morse_index_start(index);
+    uint8_t state = MORSE_JOIN_NONE;
+    for (size_t i = 0; i < n; ++i) {
+        const morse_glyph glyph =
+                morse_lookup((uint8_t) s[i], invalid, &state);
+        if (index) morse_index_glyph(&x, glyph, w.index + w.acc_len - 32, 0);
+        if (!morse_write(&w, glyph.bits, glyph.len)) return 0;
+    }
+    if (index) morse_index_end(&x);
+    if (join) *join = state;
+    // Add padding to message end to help separate messages.
+    if (!morse_write(&w, 0, 4 * glyphs[' '].len)) return 0;
+    const uint32_t len = morse_write_end(&w);
+    morse_encode_len(buf, len);
+    return 4 + (len + 7) / 8;
+}
+
+/**
+ * \brief Whether each of the n characters of s has a pattern, or
+ * delimits a prosign.
+ */
+static bool morse_valid(const char *s, const size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x;
+        memcpy(&x, s + i, sizeof(x));
+        if (morse_valid_word(x) == 0x8080808080808080) continue;
+        // Rare characters, such as Latin-1 letters, are looked up.
+        for (size_t j = i; j < i + 8; ++j) {
+            const morse_glyph glyph = glyphs[(uint8_t) s[j]];
+            if (!glyph.len && !glyph.prosign) return false;
+        }
+    }
+    for (; i < n; ++i) {
+        const morse_glyph glyph = glyphs[(uint8_t) s[i]];
+        if (!glyph.len && !glyph.prosign) return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Classify the 8 characters packed in x at once.
+ *
+ * \return The high bit of each byte of x that holds a common character
+ *      with a glyph: any ASCII character but # % * [ \ ] ^ ` and those
+ *      outside ' ' to 'z'. Others may still have one.
+ */
+static uint64_t morse_valid_word(const uint64_t x) {
+    const uint64_t ones = 0x0101010101010101;
+    const uint64_t high = 0x8080808080808080;
+    // The high bit of each byte of GE(x, c) is set if that byte of x is
+    // >= c. Setting the high bit beforehand keeps the subtraction from
+    // borrowing across bytes, which is safe as non ASCII bytes are
+    // rejected anyway.
+#define GE(x, c) ((((x) | high) - (c) * ones) & high)
+#define IN(x, lo, hi) (GE(x, lo) & ~GE(x, (hi) + 1))
+    const uint64_t valid =
+            IN(x, ' ', '"') | IN(x, '$', '$') | IN(x, '&', ')') |
+            IN(x, '+', 'Z') | IN(x, '_', '_') | IN(x, 'a', 'z');
+#undef GE
+#undef IN
+    return valid & ~x;
+}
+
+/**
+ * \brief Encode the n characters of s into buf as a list of run
+ * lengths, prefixed by its length in dot durations, once they are
+ * accepted as for morse_encode_valid().
+ *
+ * Runs alternate between off and on, starting with off. An on run is
+ * one bit: 0 for a dot, 1 for a dash. An off run is a prefix code:
+ * 0 for the gap between elements, 10 between characters, 110 between
+ * words, or 111 followed by bytes that are summed up to the length of
+ * the run, ending with the first byte that is not 0xFF. This takes
+ * about half the space of morse_encode(), and lets the end of the
+ * current run be found without scanning.
+ *
+ * \param buf May be NULL to only count the size.
+ * \return Size of the encoded message in bytes, or zero if it does not
+ *      fit.
+ */
+static uint32_t morse_encode_runs(
+        uint8_t *buf,
+        const char *s,
+        const size_t n,
+        const uint32_t size,
+        const morse_glyph invalid,
+        morse_index *index,
+        const bool quiet) {
+    morse_writer w;
+    if (!morse_writer_init(&w, buf, size, quiet)) return 0;
+    morse_indexer x = morse_index_start(index);
+    uint32_t len = 0;
+    uint32_t off = 0;  // Length of off run not yet written.
+    uint8_t join = MORSE_JOIN_NONE;
+    for (size_t i = 0; ; ++i) {
+        morse_glyph glyph;
+        if (i < n) {
+            glyph = morse_lookup((uint8_t) s[i], invalid, &join);
+            // The off run holding the start of the character is the
+            // next one written.
+            if (index) {
+                morse_index_glyph(&x, glyph, len, w.index + w.acc_len - 32);
+            }
+        } else {
+            // Add padding to message end to help separate messages.
+            glyph = (morse_glyph) {0, 4 * glyphs[' '].len, 0};
+        }
+        len += glyph.len;
+        for (uint32_t j = 0; j < glyph.len;) {
+            const bool value = (glyph.bits >> j) & 1;
+            uint32_t units = 0;
+            for (; j < glyph.len && ((glyph.bits >> j) & 1) == value; ++j) {
+                ++units;
+            }
+            if (!value) {
+                off += units;
+                continue;
+            }
+            if (!morse_write_off_run(&w, off)) return 0;
+            if (!morse_write(&w, units == 3, 1)) return 0;
+            off = 0;
+        }
+        if (i == n) break;
+    }
+    if (!morse_write_off_run(&w, off)) return 0;
+    if (index) morse_index_end(&x);
+    const uint32_t bits = morse_write_end(&w);
+    morse_encode_len(buf, len);
+    return 4 + (bits + 7) / 8;
+}
+
+static void morse_encode_len(uint8_t *buf, const uint32_t bit_len) {
+    if (!buf) return;  // Only counting the size, see morse_size_valid().
+    buf[0] = (bit_len & 0xFF000000) >> 24;
+    buf[1] = (bit_len & 0x00FF0000) >> 16;
+    buf[2] = (bit_len & 0x0000FF00) >> 8;
+    buf[3] = (bit_len & 0x000000FF);
+}
+
+/**
+ * \brief Start writing an encoded message after the length bytes of
+ * buf, which has a size of size bytes.
+ *
+ * \param quiet Whether errors are not reported on stderr.
+ */
+static bool morse_writer_init(
+        morse_writer *w, uint8_t *buf, const uint32_t size, const bool quiet) {
+    if (size < 4) {
+        if (!quiet) MORSE_REPORT("Buffer must have size of >= 5.");
+        return false;
+    }
+    const uint32_t limit = size > UINT32_MAX / 8 ? UINT32_MAX : size * 8;
+    *w = (morse_writer) {buf, 32, limit, 0, 0, quiet};
+    return true;
+}
+
+/**
+ * \brief Carry on writing an encoded message in buf, of size bytes,
+ * from bit index bit_index after its length bytes, keeping the bits
+ * before it.
+ */
+static void morse_writer_resume(
+        morse_writer *w,
+        uint8_t *buf,
+        const uint32_t size,
+        const uint32_t bit_index) {
+    morse_writer_init(w, buf, size, true);
+    const uint32_t kept = bit_index % 8;
+    w->index += bit_index - kept;
+    w->acc = kept ? buf[4 + bit_index / 8] & ((1u << kept) - 1) : 0;
+    w->acc_len = kept;
+}
+
+/**
+ * \brief Append the n (<= 32) low bits of bits, lsb first.
+ *
+ * If the buffer is full, its length is cleared and false is returned.
+ */
+static bool morse_write(morse_writer *w, const uint32_t bits, uint32_t n) {
+    if (w->index + w->acc_len + n > w->limit) {
+        if (!w->quiet) MORSE_REPORT("Buffer size limit reached.");
+        morse_encode_len(w->buf, 0);
+        return false;
+    }
+    w->acc |= (uint64_t) bits << w->acc_len;
+    w->acc_len += n;
+    if (w->acc_len >= 32) {
+        if (w->buf) {
+            morse_encode_word(w->buf + w->index / 8, (uint32_t) w->acc);
+        }
+        w->acc >>= 32;
+        w->acc_len -= 32;
+        w->index += 32;
+    }
+    return true;
+}
+
+/**
+ * \brief Append an off run of the passed length, as described for
+ * morse_encode_runs().
+ */
+static bool morse_write_off_run(morse_writer *w, uint32_t units) {
+    switch (units) {
+        case 1: return morse_write(w, 0x0, 1);
+        case 3: return morse_write(w, 0x1, 2);
+        case 7: return morse_write(w, 0x3, 3);
+    }
+    if (!morse_write(w, 0x7, 3)) return false;
+    for (; units >= 0xFF; units -= 0xFF) {
+        if (!morse_write(w, 0xFF, 8)) return false;
+    }
+    return morse_write(w, units, 8);
+}
+
+/**
+ * \brief Flush remaining bits to the buffer.
+ *
+ * \return Number of bits written after the length bytes.
+ */
+static uint32_t morse_write_end(morse_writer *w) {
+    for (uint32_t j = 0; w->buf && j < w->acc_len; j += 8) {
+        w->buf[(w->index + j) / 8] = (uint8_t) (w->acc >> j);
+    }
+    return w->index + w->acc_len - 32;
+}
+
+/**
+ * \brief Write 32 encoded bits to buf, lsb first.
+ */
+static void morse_encode_word(uint8_t *buf, const uint32_t word) {
+    buf[0] = (word & 0x000000FF);
+    buf[1] = (word & 0x0000FF00) >> 8;
+    buf[2] = (word & 0x00FF0000) >> 16;
+    buf[3] = (word & 0xFF000000) >> 24;
+}
+
+/**
+ * \brief Read the 32 bits of an encoded message of len bits from bit
+ * index bit_index, a multiple of 8, without reading past its end.
+ *
+ * Bytes past the end are read as zero.
+ */
+static uint32_t morse_load_word(
+        const uint8_t *buf, const uint32_t bit_index, const uint32_t len) {
+    const uint8_t *const p = buf + 4 + bit_index / 8;
+    uint32_t word = 0;
+    if (len - bit_index >= 32) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(&word, p, 4);  // A single load, aligned or not.
+#else
+        word = p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16)
+                | ((uint32_t) p[3] << 24);
+#endif  // __BYTE_ORDER__
+        return word;
+    }
+    for (uint32_t j = 0; bit_index + j * 8 < len; ++j) {
+        word |= (uint32_t) p[j] << (8 * j);
+    }
+    return word;
+}
+
+/**
+ * \brief Get the first index from from (< 32) of a bit of bits without
+ * the passed value, or 32 if there is none.
+ */
+static uint32_t morse_word_edge(
+        uint32_t bits, const bool value, const uint32_t from) {
+    bits = (value ? ~bits : bits) >> from;
+    return bits ? from + morse_ctz(bits) : 32;
+}
+
+/**
+ * \brief Count trailing zero bits of x, which is not 0.
+ */
+static unsigned morse_ctz(uint32_t x) {
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctz(x);
+#else
+    unsigned n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif  // __GNUC__
+}
+
+/**
+ * \brief Move run cursor to the run containing dot duration i of a
+ * run length encoded message.
+ */
+static void morse_run_seek(
+        const uint8_t *buf, morse_run_cursor *run, const uint32_t i) {
+    if (i < run->start) *run = morse_run_start;
+    while (run->start + run->units <= i) morse_run_next(buf, run);
+}
+
+/**
+ * \brief Advance run cursor to the following run.
+ */
+static void morse_run_next(const uint8_t *buf, morse_run_cursor *run) {
+    run->start += run->units;
+    run->level = !run->level;
+    if (run->level) {
+        run->units = morse_bit(buf, run->pos++) ? 3 : 1;
+    } else if (!morse_bit(buf, run->pos++)) {
+        run->units = 1;
+    } else if (!morse_bit(buf, run->pos++)) {
+        run->units = 3;
+    } else if (!morse_bit(buf, run->pos++)) {
+        run->units = 7;
+    } else {
+        run->units = 0;
+        uint32_t byte;
+        do {
+            byte = 0;
+            for (uint32_t j = 0; j < 8; ++j) {
+                byte |= morse_bit(buf, run->pos++) << j;
+            }
+            run->units += byte;
+        } while (byte == 0xFF);
+    }
+}
+
+// --------------------------------------------------------------------
+
+
+#ifdef MORSE_MAIN
+
+static void morse_console(bool value) {
+    printf(value ? "\r    XXX    " : "\r           ");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    // Set dot duration, before the message that is played with it.
+    if (argc > 2) {
+        int dot_duration = atoi(argv[2]);
+        if (dot_duration <= 10) {
+            fprintf(stderr, "Invalid dot duration: %s", argv[2]);
+        }
+        morse_set_timing((morse_timing) {dot_duration, dot_duration});
+    }
+
+    // Set message.
+    if (argc > 1) {
+        morse(argv[1], true);
+    } else {
+        morse("Hello World", true);
     }
     
     morse_cb = morse_console;
     while (1) {
-        morse_update(10);
-        usleep(10 * 1000);
+        const uint32_t wait = morse_next_edge();
+        if (wait == MORSE_NO_EDGE) return 1;  // Message was invalid.
+        usleep(wait * 1000);
+        morse_update(wait);
     }
 }
 
@@ -2,18 +2,471 @@
 #define MORSE_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+  #include <atomic>
+  #define MORSE_ATOMIC(T) std::atomic<T>
+#else
+  #include <stdatomic.h>
+  #define MORSE_ATOMIC(T) _Atomic(T)
+#endif  // __cplusplus
 
-#define MORSE_MAX_LEN 1024
+
+#ifndef MORSE_MAX_LEN
+  // Size of each of the two buffers built into a context, or 0 to only
+  // use buffers passed to morse_ctx_init_buffers().
+  #define MORSE_MAX_LEN 1024
+#endif  // MORSE_MAX_LEN
+#define MORSE_NO_EDGE UINT32_MAX
+
+#ifndef MORSE_STREAM_LEN
+  #define MORSE_STREAM_LEN 16  // Must be a power of two.
+#endif  // MORSE_STREAM_LEN
+
+#ifndef MORSE_QUEUE_LEN
+  #define MORSE_QUEUE_LEN 16  // Messages. Must be a power of two < 256.
+#endif  // MORSE_QUEUE_LEN
+
+#ifndef MORSE_QUEUE_SIZE
+  // Size of the arena built into a queue, or 0 to only use arenas
+  // passed to morse_queue_init_buffer().
+  #define MORSE_QUEUE_SIZE 4096
+#endif  // MORSE_QUEUE_SIZE
+
+#ifndef MORSE_CACHE_LEN
+  #define MORSE_CACHE_LEN 8  // Messages kept by a morse_cache.
+#endif  // MORSE_CACHE_LEN
+
+#ifndef MORSE_CACHE_TEXT
+  #define MORSE_CACHE_TEXT 32  // Longest string cached. Must be < 256.
+#endif  // MORSE_CACHE_TEXT
+
+#ifndef MORSE_CACHE_SIZE
+  // Bytes of each cached message, enough for any string of
+  // MORSE_CACHE_TEXT chars as MORSE_FORMAT_BITS by default.
+  #define MORSE_CACHE_SIZE 96
+#endif  // MORSE_CACHE_SIZE
+
+#ifndef MORSE_INDEX_LEN
+  #define MORSE_INDEX_LEN 16  // Marks per sent message. Must be even.
+#endif  // MORSE_INDEX_LEN
+
+#ifndef MORSE_LOOP_LEN
+  // Runs of a repeating message a context caches in storage built into
+  // it, or 0 to only use memory passed to morse_ctx_init_loop().
+  #define MORSE_LOOP_LEN 128
+#endif  // MORSE_LOOP_LEN
+
+#ifndef MORSE_STATS
+  // Whether contexts count what they do, for morse_ctx_get_stat().
+  // Disabled, the counters are left out, and cost nothing.
+  #define MORSE_STATS 0
+#endif  // MORSE_STATS
+
+#ifndef MORSE_TRACE
+  // Whether contexts have a trace_cb, called as messages start, end and
+  // are switched. Disabled, it is left out, and costs nothing.
+  #define MORSE_TRACE 0
+#endif  // MORSE_TRACE
+
+#ifndef MORSE_STDIO
+  // Whether errors are reported on stderr, by morse.c and morse_sched.c.
+  // Disabled, stdio is not linked, for parts without it or the flash to
+  // spare. See morse_tiny.h for a player for the smallest parts.
+  #define MORSE_STDIO 1
+#endif  // MORSE_STDIO
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+
+typedef struct morse_ctx morse_ctx;
+
+typedef enum {
+    MORSE_FORMAT_BITS,  // One bit per dot duration.
+    MORSE_FORMAT_RUNS,  // Prefix coded list of alternating run lengths.
+    MORSE_FORMAT_STREAM,  // Live character from a stream. Not for format.
+} morse_format;
+
+/**
+ * \brief Handling of characters that have no pattern.
+ *
+ * Prosigns are written as their letters between '<' and '>', such as
+ * "<SK>", and are always accepted.
+ */
+typedef enum {
+    MORSE_POLICY_ERROR,  // Refuse strings holding them.
+    MORSE_POLICY_SKIP,  // Leave them out.
+    MORSE_POLICY_SUBSTITUTE,  // Send '?' in their place.
+} morse_policy;
+
+/**
+ * \brief Counters kept by each context if MORSE_STATS is set.
+ */
+typedef enum {
+    MORSE_STAT_ENCODES,  // Messages encoded to send or queue.
+    MORSE_STAT_INVALID,  // Encodes failed on a char with no pattern.
+    MORSE_STAT_TOO_LONG,  // Encodes failed as the buffer is too small.
+    MORSE_STAT_QUEUE_FULL,  // Messages not queued as the queue is full.
+    MORSE_STAT_SWITCHES,  // Messages or streamed chars made live.
+    MORSE_STAT_CALLBACKS,  // Calls of cb or edge_cb.
+    MORSE_STAT_SUPPRESSED,  // Calls of edge_cb left out, as unchanged.
+    MORSE_STAT_MAX_ELAPSED,  // Longest elapsed_ms passed to an update.
+    MORSE_STAT_MAX_LATE,  // Most ms an edge was reported after it was due.
+    MORSE_STAT_CACHE_HITS,  // Messages sent from the cache, not encoded.
+    MORSE_STAT_COUNT,
+} morse_stat;
+
+/**
+ * \brief Event passed to trace_cb if MORSE_TRACE is set.
+ */
+typedef enum {
+    MORSE_TRACE_START,  // Live message starts to play, or plays again.
+    MORSE_TRACE_END,  // Live message is complete, or cut short.
+    MORSE_TRACE_SWITCH,  // Next message or streamed char is made live.
+} morse_trace;
+
+/**
+ * \brief Position in a message encoded as MORSE_FORMAT_RUNS.
+ */
+typedef struct {
+    uint32_t pos;  // Bit index of the following run.
+    uint32_t start;  // Dot duration at which the current run starts.
+    uint32_t units;  // Length of the current run in dot durations.
+    bool level;
+} morse_run_cursor;
+
+/**
+ * \brief Speed at which a message is played.
+ *
+ * Dots, dashes and the gaps within a character take one, three and
+ * one dot_ms. The gaps between characters and words take three and
+ * seven gap_ms, which is longer than dot_ms for Farnsworth timing.
+ * See morse_wpm().
+ */
+typedef struct {
+    uint16_t dot_ms;
+    uint16_t gap_ms;
+} morse_timing;
+
+/**
+ * \brief Start of a character in an encoded message.
+ */
+typedef struct {
+    uint32_t unit;  // Dot duration at which the character starts.
+    uint32_t gaps;  // Dot durations before unit timed by gap_ms.
+    uint32_t run_pos;  // For MORSE_FORMAT_RUNS, bit index of the run
+    uint32_t run_start;  // holding unit, and its first dot duration.
+} morse_mark;
+
+/**
+ * \brief Index of the characters of a message, built as it is encoded,
+ * to seek in it without playing it from the start.
+ *
+ * Holds a mark for every (1 << shift)th character, where shift grows
+ * as needed to fit the message in MORSE_INDEX_LEN marks.
+ */
+typedef struct {
+    morse_mark marks[MORSE_INDEX_LEN];
+    uint32_t gaps;  // Dot durations of the message timed by gap_ms.
+    uint16_t len;  // Marks in use.
+    uint8_t shift;
+} morse_index;
+
+/**
+ * \brief Point reached in the live message of a context.
+ *
+ * Characters are counted as sent: a space counts as one, as does a
+ * prosign, and prosign delimiters and skipped characters do not.
+ */
+typedef struct {
+    uint32_t time_ms;  // Since the message started.
+    uint32_t unit;  // Dot duration being played.
+    uint32_t chr;  // Index of the character being played.
+} morse_position;
+
+/**
+ * \brief End of a run of a repeating message, cached by its context.
+ */
+typedef struct {
+    uint32_t unit;  // Dot duration at which the run ends.
+    uint32_t time_ms;  // Since the message started.
+} morse_loop_edge;
+
+/**
+ * \brief Summary of a piece of a longer text, taken by
+ * morse_piece_measure() so that the pieces of a text can be encoded
+ * apart, and at once, with morse_piece_encode().
+ *
+ * A piece starts at the start of the text, or straight after a space,
+ * which is where the state of any prosign it starts in is known. The
+ * piece before decides whether it does, through delimited and
+ * in_prosign.
+ */
+typedef struct {
+    uint64_t bits;  // Encoded length if started outside of a prosign.
+    uint64_t prosign_bits;  // If started within one.
+    uint64_t invalid;  // Characters without a pattern.
+    bool delimited;  // Whether it holds a '<' or '>'.
+    bool in_prosign;  // If delimited, whether it ends within a prosign.
+} morse_piece;
+
+/**
+ * \brief Message waiting in a morse_queue.
+ */
+typedef struct {
+    MORSE_ATOMIC(uint8_t) state;  // Ownership of the entry.
+    uint8_t format;
+    uint8_t priority;
+    uint8_t plays;  // Times to play, or 0 to repeat.
+    bool preempt;
+    morse_timing timing;
+    uint16_t seq;  // Order in which the entry was queued.
+    uint32_t offset;  // Of the message in the queue's arena.
+    uint32_t size;  // Of the message in bytes.
+} morse_queue_entry;
+
+/**
+ * \brief Bounded queue of encoded messages, waiting to be played by a
+ * context.
+ *
+ * Messages are encoded into a single arena, of MORSE_QUEUE_SIZE bytes
+ * unless one is passed in, in the order they are queued, and up to
+ * MORSE_QUEUE_LEN may wait at once. Like the rest of a context, the
+ * queue is shared by one producer and one consumer without locking.
+ * Fields should be treated as private.
+ */
+typedef struct {
+    morse_queue_entry entries[MORSE_QUEUE_LEN];
+    MORSE_ATOMIC(uint16_t) head;  // Count of messages queued.
+    MORSE_ATOMIC(uint8_t) preempt_seq;  // Count of preempting messages.
+    uint8_t preempt_ack;  // Count of preempting messages seen.
+    uint16_t taken;  // Count of messages taken by the consumer.
+    uint16_t tail;  // Count of entries freed by the producer.
+    uint32_t arena_head;  // Offset of free space, owned by producer.
+    uint32_t arena_tail;  // Offset of oldest message not yet freed.
+    uint8_t *arena;
+    uint32_t arena_size;
+#if MORSE_QUEUE_SIZE > 0
+    uint8_t storage[MORSE_QUEUE_SIZE];  // Default arena.
+#endif  // MORSE_QUEUE_SIZE
+} morse_queue;
+
+/**
+ * \brief Message kept encoded in a morse_cache.
+ */
+typedef struct {
+    uint32_t hash;  // Of text, format and policy.
+    uint32_t used;  // Lookup of the cache that last used it, or 0 if free.
+    uint8_t format;
+    uint8_t policy;
+    uint8_t n;  // Characters of text.
+    char text[MORSE_CACHE_TEXT];
+    morse_index index;
+    uint8_t buf[MORSE_CACHE_SIZE];
+} morse_cache_entry;
+
+/**
+ * \brief Fixed set of recently sent messages, kept encoded so that
+ * sending one again only hands over a pointer to it.
+ *
+ * Strings of up to MORSE_CACHE_TEXT characters sent by a context that
+ * has the cache are looked up by a hash of their text, format and
+ * policy, and if absent are encoded in place of the least recently
+ * used message that is not playing. A cache may be used by only one
+ * context, from its producer. Fields should be treated as private.
+ */
+typedef struct {
+    morse_cache_entry entries[MORSE_CACHE_LEN];
+    uint32_t lookups;  // Count of strings looked up.
+} morse_cache;
+
+/**
+ * \brief State of a single transmitter.
+ *
+ * Each context owns its timing, and its buffers unless they are passed
+ * to morse_ctx_init_buffers(), so that any number of channels can be
+ * driven independently. Fields should be treated as private, other
+ * than timing, format, policy, queue, cache, cb, edge_cb, trace_cb and
+ * user, which may be set after morse_ctx_init(). timing, format and
+ * policy apply to messages sent, or characters streamed, after they
+ * are set. The consumer may also set live_timing to change the speed
+ * of the live message from its next edge.
+ *
+ * Messages are handed from a producer, which calls morse_ctx_send(),
+ * morse_ctx_append(), morse_ctx_stream(), morse_ctx_stop() and
+ * morse_ctx_interrupt(), to a consumer, which calls morse_ctx_update()
+ * and morse_ctx_next_edge(), or their _us forms, through atomics, so
+ * the two may run in different threads, or the consumer in an
+ * interrupt, without locking. There may be only one producer and one
+ * consumer per context.
+ */
+struct morse_ctx {
+    // State used on every update is kept together at the start.
+    const uint8_t *live_buf;
+    uint32_t live_len;  // Cached length of live_buf.
+    uint32_t elapsed_time;  // ms since message start.
+    uint32_t edge_time;  // ms since message start of next edge.
+    uint32_t clock_us;  // Of elapsed_time, see morse_ctx_update_us().
+    uint32_t pos;  // Dot duration at which the current run starts.
+    uint32_t edge;  // Dot duration at which the current run ends.
+    morse_timing live_timing;
+    MORSE_ATOMIC(bool) repeat;
+    MORSE_ATOMIC(uint8_t) pending;  // Ownership of next_buf.
+    bool level;  // Last value passed to edge_cb.
+    bool run_level;  // Of the run starting at pos.
+    uint8_t live_format;
+    void (*cb)(morse_ctx *ctx, bool value);
+    void (*edge_cb)(morse_ctx *ctx, bool value, uint32_t offset_ms);
+    morse_run_cursor run;  // Position in live_buf if it holds runs.
+    uint32_t glyph;  // Pattern of live streamed character.
+    uint8_t stream_join;  // Prosign state of streamed characters.
+    void *user;
+
+    const morse_index *live_index;  // Of live_buf, if it has one.
+    morse_loop_edge *loop;  // Runs of live message, if repeating.
+    uint32_t loop_size;  // Runs loop has room for.
+    uint32_t loop_len;  // Runs cached, or 0 if live message is not.
+    uint32_t loop_run;  // Index in loop of the run starting at pos.
+    morse_timing loop_timing;  // Live timing the runs were timed with.
+    bool loop_level;  // Of the first run.
+
+    const uint8_t *next_buf;
+    const uint8_t *played_buf;  // Last of next_buf taken by consumer.
+    uint8_t *append_buf;  // Message morse_ctx_append() carries on, or NULL.
+    uint32_t append_len;  // Bits of text in append_buf, before padding.
+    uint8_t append_join;  // Prosign state at the end of append_buf.
+    bool append_open;  // Whether append_buf is without its padding.
+    const morse_index *next_index;
+    morse_timing next_timing;
+    bool repeat_next;
+    uint8_t next_format;
+    uint8_t format;  // morse_format used to encode sent strings.
+    uint8_t policy;  // morse_policy for strings sent from now on.
+    morse_timing timing;  // Used to play sent messages.
+    MORSE_ATOMIC(morse_timing) stream_timing;  // Of streamed chars.
+    morse_queue *queue;  // Optional, see morse_ctx_enqueue().
+    morse_cache *cache;  // Optional, see morse_cache_init().
+    uint8_t live_entry;  // Index in queue of live message.
+    uint8_t live_priority;
+    uint8_t plays;  // Remaining plays of live message, or 0 to repeat.
+    MORSE_ATOMIC(uint16_t) stream_head;  // Count of chars pushed.
+    MORSE_ATOMIC(uint16_t) stream_tail;  // Count of chars taken.
+    MORSE_ATOMIC(uint16_t) stream_drop;  // Head at last interrupt.
+    MORSE_ATOMIC(uint8_t) interrupt_seq;  // Count of interrupts.
+    uint8_t interrupt_ack;  // Count of interrupts applied by consumer.
+    char stream[MORSE_STREAM_LEN];
+#if MORSE_TRACE
+    void (*trace_cb)(morse_ctx *ctx, morse_trace event);  // Consumer.
+#endif  // MORSE_TRACE
+#if MORSE_STATS
+    // Each written by only one of the producer and the consumer.
+    MORSE_ATOMIC(uint32_t) stats[MORSE_STAT_COUNT];
+#endif  // MORSE_STATS
+    uint8_t *buf1;
+    uint8_t *buf2;
+    uint32_t buf_size;  // Of each of buf1 and buf2.
+    morse_index index1;  // Of buf1 and buf2.
+    morse_index index2;
+#if MORSE_MAX_LEN > 0
+    uint8_t storage[2][MORSE_MAX_LEN];  // Default buf1 and buf2.
+#endif  // MORSE_MAX_LEN
+#if MORSE_LOOP_LEN > 0
+    morse_loop_edge loop_storage[MORSE_LOOP_LEN];  // Default loop.
+#endif  // MORSE_LOOP_LEN
+};
 
 extern void (*morse_cb)(bool value);
+extern void (*morse_edge_cb)(bool value, uint32_t offset_ms);
+#if MORSE_TRACE
+extern void (*morse_trace_cb)(morse_trace event);
+#endif  // MORSE_TRACE
 
 
 void morse(const char *s, bool repeat);
+void morse_encoded(const uint8_t *buf, bool repeat);
+bool morse_append(const char *s);
+void morse_append_end(void);
 void morse_update(uint32_t elapsed_ms);
+uint32_t morse_next_edge(void);
+void morse_update_us(uint32_t now_us);
+uint32_t morse_next_edge_us(uint32_t now_us);
 void morse_stop(void);
+size_t morse_stream(const char *s, size_t n);
 void morse_interrupt(void);
+bool morse_seek(uint32_t time_ms);
+void morse_set_timing(morse_timing timing);
+void morse_set_policy(morse_policy policy);
+void morse_set_queue(morse_queue *queue);
+void morse_set_cache(morse_cache *cache);
+void morse_set_buffers(uint8_t *mem, size_t size);
+bool morse_enqueue(
+        const char *s, uint8_t plays, uint8_t priority, bool preempt);
+uint32_t morse_get_stat(morse_stat stat);
+
+void morse_ctx_init(morse_ctx *ctx);
+void morse_ctx_init_buffers(morse_ctx *ctx, uint8_t *mem, size_t size);
+void morse_ctx_init_loop(morse_ctx *ctx, morse_loop_edge *mem, size_t n);
+void morse_ctx_send(morse_ctx *ctx, const char *s, bool repeat);
+void morse_ctx_send_encoded(
+        morse_ctx *ctx, const uint8_t *buf, bool repeat);
+bool morse_ctx_append(morse_ctx *ctx, const char *s);
+void morse_ctx_append_end(morse_ctx *ctx);
+void morse_ctx_update(morse_ctx *ctx, uint32_t elapsed_ms);
+void morse_update_all(morse_ctx *ctxs, size_t n, uint32_t elapsed_ms);
+uint32_t morse_ctx_next_edge(const morse_ctx *ctx);
+void morse_ctx_update_us(morse_ctx *ctx, uint32_t now_us);
+uint32_t morse_ctx_edge_us(const morse_ctx *ctx, uint32_t offset_ms);
+uint32_t morse_ctx_next_edge_us(const morse_ctx *ctx, uint32_t now_us);
+void morse_ctx_stop(morse_ctx *ctx);
+size_t morse_ctx_stream(morse_ctx *ctx, const char *s, size_t n);
+void morse_ctx_interrupt(morse_ctx *ctx);
+bool morse_ctx_position(const morse_ctx *ctx, morse_position *position);
+bool morse_ctx_seek(morse_ctx *ctx, uint32_t time_ms);
+bool morse_ctx_seek_char(morse_ctx *ctx, uint32_t chr);
+uint32_t morse_ctx_get_stat(const morse_ctx *ctx, morse_stat stat);
+void morse_ctx_reset_stats(morse_ctx *ctx);
+
+void morse_queue_init(morse_queue *queue);
+void morse_queue_init_buffer(morse_queue *queue, uint8_t *mem, size_t size);
+bool morse_ctx_enqueue(
+        morse_ctx *ctx,
+        const char *s,
+        uint8_t plays,
+        uint8_t priority,
+        bool preempt);
+
+void morse_cache_init(morse_cache *cache);
+
+morse_timing morse_wpm(uint32_t wpm, uint32_t farnsworth_wpm);
+
+uint32_t morse_encoded_size(
+        const char *s, morse_format format, morse_policy policy);
+bool morse_encode(uint8_t *buf, const char *s, uint32_t size);
+size_t morse_encode_batch(
+        uint8_t *const *bufs, const char *const *s, size_t n, uint32_t size);
+void morse_piece_measure(
+        morse_piece *piece, const char *s, size_t n, morse_policy policy);
+void morse_piece_encode(
+        uint8_t *buf,
+        uint32_t bit,
+        const char *s,
+        size_t n,
+        morse_policy policy,
+        bool in_prosign,
+        uint8_t edges[2]);
+uint32_t morse_piece_finish(uint8_t *buf, uint32_t bits, uint32_t size);
+uint32_t morse_len(const uint8_t *buf);
+bool morse_bit(const uint8_t *buf, uint32_t bit_index);
+uint32_t morse_edge(const uint8_t *buf, uint32_t bit_index, uint32_t len);
+
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif  // __cplusplus
 
 
 #endif  // MORSE_H_
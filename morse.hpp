@@ -0,0 +1,145 @@
+#ifndef MORSE_HPP_
+#define MORSE_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "morse.h"
+#include "morse_glyphs.h"
+
+
+/**
+ * \brief Define a message encoded at compile time.
+ *
+ * Defines a constexpr std::array named name, holding text encoded in
+ * the layout of MORSE_FORMAT_BITS, as morse_ctx_send() would have
+ * encoded it. As it is constant, it is placed in read-only memory
+ * (flash), and can be played in place with morse_cx::send() or
+ * morse_ctx_send_encoded(). Prosigns may be written as for
+ * morse_ctx_send(), such as "<SK>". A character without a pattern
+ * fails compilation.
+ *
+ *   MORSE_MESSAGE(beacon, "N0CALL BEACON");
+ *   morse_cx::send(&ctx, beacon, true);
+ */
+#define MORSE_MESSAGE(name, text)                                      \
+    alignas(4) static constexpr auto name =                            \
+            ::morse_cx::encode<::morse_cx::encoded_size(text)>(text)
+
+
+namespace morse_cx {
+
+struct glyph {
+    std::uint32_t bits;
+    std::uint8_t len;  // In dot durations. Zero if char cannot be encoded.
+};
+
+// State of joining the characters of a prosign, between '<' and '>'.
+enum class join { none, first, next };
+
+// Not defined. Being reached while encoding at compile time is an
+// error, and using it at run time fails to link.
+void invalid_char();
+
+/**
+ * \brief Get the pattern used to encode c.
+ */
+constexpr glyph lookup(const char c) {
+    switch (static_cast<unsigned char>(c)) {
+#define MORSE_HPP_GLYPH(ch, bits, len) case ch: return {bits, len};
+#define MORSE_HPP_LETTER(ch, bits, len) \
+    case ch: case (ch) - 'A' + 'a': return {bits, len};
+        MORSE_GLYPHS(MORSE_HPP_GLYPH, MORSE_HPP_LETTER)
+#undef MORSE_HPP_GLYPH
+#undef MORSE_HPP_LETTER
+        default: return {0, 0};
+    }
+}
+
+/**
+ * \brief Get the pattern appended for c, as morse_ctx_send() does.
+ *
+ * The characters of a prosign are joined by dropping the gap before
+ * each but the first, and its delimiters have an empty pattern.
+ */
+constexpr glyph next(const char c, join &state) {
+    if (c == '<' || c == '>') {
+        state = c == '<' ? join::first : join::none;
+        return {0, 0};
+    }
+    glyph g = lookup(c);
+    if (!g.len) invalid_char();
+    if (!g.bits) {
+        // A space is sent as usual, and starts a new prosign after it.
+        if (state != join::none) state = join::first;
+        return g;
+    }
+    if (state == join::next) {
+        g.bits >>= 2;
+        g.len -= 2;
+    } else if (state == join::first) {
+        state = join::next;
+    }
+    return g;
+}
+
+/**
+ * \brief Get length in dot durations of s once encoded, including
+ * padding at the end of the message.
+ */
+constexpr std::uint32_t encoded_len(const char *s) {
+    std::uint32_t len = 4 * lookup(' ').len;
+    join state = join::none;
+    for (; *s != '\0'; ++s) len += next(*s, state).len;
+    return len;
+}
+
+/**
+ * \brief Get size in bytes of the buffer needed to encode s.
+ */
+constexpr std::size_t encoded_size(const char *s) {
+    return 4 + (encoded_len(s) + 7) / 8;
+}
+
+/**
+ * \brief Encode s into a buffer of Size bytes.
+ *
+ * Size should be encoded_size(s), or more.
+ */
+template <std::size_t Size>
+constexpr std::array<std::uint8_t, Size> encode(const char *s) {
+    std::array<std::uint8_t, Size> buf{};
+    const std::uint32_t len = encoded_len(s);
+    static_assert(Size >= 4, "Buffer must have room for the length");
+    if ((len + 7) / 8 + 4 > Size) invalid_char();
+    buf[0] = (len & 0xFF000000) >> 24;
+    buf[1] = (len & 0x00FF0000) >> 16;
+    buf[2] = (len & 0x0000FF00) >> 8;
+    buf[3] = (len & 0x000000FF);
+    std::uint32_t i = 32;  // Skip length bytes.
+    join state = join::none;
+    for (; *s != '\0'; ++s) {
+        const glyph g = next(*s, state);
+        for (std::uint32_t j = 0; j < g.len; ++j, ++i) {
+            buf[i / 8] |= ((g.bits >> j) & 1) << (i % 8);
+        }
+    }
+    return buf;
+}
+
+/**
+ * \brief Set a message defined by MORSE_MESSAGE() to be played.
+ *
+ * See morse_ctx_send_encoded().
+ */
+template <std::size_t Size>
+void send(morse_ctx *ctx, const std::array<std::uint8_t, Size> &message,
+          const bool repeat = false) {
+    morse_ctx_send_encoded(ctx, message.data(), repeat);
+}
+
+}  // namespace morse_cx
+
+
+#endif  // MORSE_HPP_
@@ -0,0 +1,949 @@
+/**
+ * Benchmarks of the encode and update paths.
+ *
+ * Build with the library, for example:
+ *   cc -O2 -pthread morse.c morse_sched.c morse_pipeline.c morse_bench.c \
+ *           -o morse_bench
+ *
+ * Results are printed to stdout as one JSON object per line, so that
+ * they can be collected and compared between compilers and targets.
+ * On targets without clock_gettime(), define MORSE_BENCH_NOW_NS() to
+ * read a monotonic nanosecond (or cycle) counter.
+ *
+ * Each way of encoding a string is first checked against morse_encode()
+ * on random strings, and the run fails if any differs. Those backends
+ * that report errors do so on stderr, which may be discarded. Reported
+ * as "check" lines, the same strings sent as MORSE_FORMAT_RUNS must
+ * play the same edges, a pipeline of many chunks must match
+ * morse_encode(), and a few cases that once went wrong are played.
+ */
+#include "morse.h"
+#include "morse_pipeline.h"
+#include "morse_sched.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MORSE_BENCH_NOW_NS
+  #include <time.h>
+  #define MORSE_BENCH_NOW_NS() morse_bench_now_ns()
+  #define MORSE_BENCH_CLOCK_GETTIME
+#endif  // MORSE_BENCH_NOW_NS
+
+#ifndef __VERSION__
+  #define __VERSION__ "unknown"
+#endif  // __VERSION__
+
+#define MORSE_BENCH_CASES 256  // Random strings each backend is run on.
+#define MORSE_BENCH_LOG 64  // Edges kept by morse_bench_log_cb().
+#define MORSE_BENCH_CORPUS (6 << 20)  // Chars of the pipeline check text.
+
+
+/**
+ * \brief Way of encoding a string as MORSE_FORMAT_BITS, into a buffer
+ * of MORSE_MAX_LEN bytes, if it is not encoded elsewhere.
+ *
+ * \return The encoded message, or NULL if the string was not encoded.
+ */
+typedef const uint8_t *(*morse_bench_encoder)(uint8_t *buf, const char *s);
+
+typedef struct {
+    const char *name;
+    morse_bench_encoder encode;
+} morse_bench_backend;
+
+
+// --------------------------------------------------------------------
+
+
+static uint64_t morse_bench_min_ns = 200000000;  // Per benchmark.
+static volatile uint32_t morse_bench_sink;
+static uint32_t morse_bench_callbacks;
+static morse_ctx morse_bench_ctx;
+static morse_ctx morse_bench_ctxs[MORSE_SCHED_LEN];
+static morse_sched morse_bench_sched;
+static char morse_bench_cases[MORSE_BENCH_CASES][MORSE_MAX_LEN + 1];
+static uint8_t morse_bench_expected[MORSE_BENCH_CASES][MORSE_MAX_LEN];
+static bool morse_bench_encoded[MORSE_BENCH_CASES];
+static bool morse_bench_failed;
+// Edges passed to morse_bench_log_cb(), as twice their time plus value.
+static uint32_t morse_bench_log[MORSE_BENCH_LOG];
+static size_t morse_bench_log_len;
+static uint32_t morse_bench_log_edges;  // Including those not kept.
+static uint32_t morse_bench_log_hash;  // FNV-1a of every edge.
+static uint32_t morse_bench_log_ms;  // Time at the start of the update.
+
+
+// --------------------------------------------------------------------
+
+
+#ifdef MORSE_BENCH_CLOCK_GETTIME
+static uint64_t morse_bench_now_ns(void);
+#endif  // MORSE_BENCH_CLOCK_GETTIME
+static void morse_bench_payload(char *s, size_t n);
+static void morse_bench_cb(morse_ctx *ctx, bool value);
+static void morse_bench_edge_cb(
+        morse_ctx *ctx, bool value, uint32_t offset_ms);
+static void morse_bench_random(char *s, size_t n, uint32_t *state);
+static bool morse_bench_same(const uint8_t *a, const uint8_t *b);
+static void morse_bench_log_cb(
+        morse_ctx *ctx, bool value, uint32_t offset_ms);
+static void morse_bench_log_init(morse_ctx *ctx);
+static void morse_bench_play(morse_ctx *ctx, uint32_t tick_ms);
+static void morse_bench_check(const char *name, bool ok);
+
+static const uint8_t *morse_bench_by_encode(uint8_t *buf, const char *s);
+static const uint8_t *morse_bench_by_send(uint8_t *buf, const char *s);
+static const uint8_t *morse_bench_by_batch(uint8_t *buf, const char *s);
+static const uint8_t *morse_bench_by_pipeline(uint8_t *buf, const char *s);
+static const uint8_t *morse_bench_by_append(uint8_t *buf, const char *s);
+
+static void morse_bench_encode(morse_format format, size_t chars);
+static void morse_bench_batch(size_t chars);
+static void morse_bench_rotation(bool cached);
+static void morse_bench_update(bool edges, uint32_t tick_ms);
+static void morse_bench_tickless(void);
+static void morse_bench_edges(bool silence);
+static void morse_bench_beacon(uint32_t tick_ms);
+static void morse_bench_channels(bool sched, uint32_t tick_ms);
+static void morse_bench_pipeline(unsigned threads);
+static void morse_bench_cases_init(void);
+static void morse_bench_backend_run(const morse_bench_backend *backend);
+static void morse_bench_check_seek(void);
+static void morse_bench_check_ends(void);
+static void morse_bench_check_append(void);
+static void morse_bench_check_runs(void);
+static void morse_bench_check_pipeline(void);
+
+
+// --------------------------------------------------------------------
+
+
+int main(int argc, char **argv) {
+    // Set minimum time spent in each benchmark.
+    if (argc > 1) {
+        const int min_ms = atoi(argv[1]);
+        if (min_ms <= 0) {
+            fprintf(stderr, "Invalid benchmark time: %s", argv[1]);
+            return 1;
+        }
+        morse_bench_min_ns = (uint64_t) min_ms * 1000000;
+    }
+    printf("{\"bench\":\"info\",\"compiler\":\"%s\",\"max_len\":%d}\n",
+           __VERSION__, MORSE_MAX_LEN);
+    morse_bench_check_seek();
+    morse_bench_check_ends();
+    morse_bench_check_append();
+
+    static const size_t sizes[] = {8, 32, 128, 512};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        morse_bench_encode(MORSE_FORMAT_BITS, sizes[i]);
+        morse_bench_encode(MORSE_FORMAT_RUNS, sizes[i]);
+    }
+    morse_bench_batch(8);
+    morse_bench_rotation(false);
+    morse_bench_rotation(true);
+    static const uint32_t ticks[] = {1, 10, 50};
+    for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); ++i) {
+        morse_bench_update(false, ticks[i]);
+        morse_bench_update(true, ticks[i]);
+    }
+    morse_bench_tickless();
+    morse_bench_edges(false);
+    morse_bench_edges(true);
+    static const uint32_t beacon_ticks[] = {10, 1000, 60000};
+    for (size_t i = 0; i < sizeof(beacon_ticks) / sizeof(beacon_ticks[0]);
+            ++i) {
+        morse_bench_beacon(beacon_ticks[i]);
+    }
+    for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); ++i) {
+        morse_bench_channels(false, ticks[i]);
+        morse_bench_channels(true, ticks[i]);
+    }
+    static const unsigned threads[] = {1, 2, 4, 8};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        morse_bench_pipeline(threads[i]);
+    }
+    static const morse_bench_backend backends[] = {
+        {"encode", morse_bench_by_encode},
+        {"send", morse_bench_by_send},
+        {"batch", morse_bench_by_batch},
+        {"pipeline", morse_bench_by_pipeline},
+        {"append", morse_bench_by_append},
+    };
+    morse_bench_cases_init();
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+        morse_bench_backend_run(&backends[i]);
+    }
+    morse_bench_check_runs();
+    morse_bench_check_pipeline();
+    return morse_bench_failed;
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Time encoding of random payloads of the passed length.
+ */
+static void morse_bench_encode(const morse_format format, const size_t chars) {
+    char s[513];
+    morse_bench_payload(s, chars);
+    morse_ctx_init(&morse_bench_ctx);
+    morse_bench_ctx.format = format;
+    uint64_t iterations = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 64; ++i) morse_ctx_send(&morse_bench_ctx, s, true);
+        iterations += 64;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"encode\",\"format\":\"%s\",\"chars\":%zu,"
+           "\"iterations\":%llu,\"ns_per_op\":%.1f,\"chars_per_sec\":%.0f}\n",
+           format == MORSE_FORMAT_RUNS ? "runs" : "bits",
+           chars,
+           (unsigned long long) iterations,
+           (double) elapsed / iterations,
+           (double) chars * iterations * 1e9 / elapsed);
+}
+
+/**
+ * \brief Time morse_encode_batch() on a batch of distinct payloads of
+ * the passed length.
+ */
+static void morse_bench_batch(const size_t chars) {
+    enum {BATCH = 1024};
+    static char text[BATCH][33];
+    static uint8_t encoded[BATCH][128];
+    const char *s[BATCH];
+    uint8_t *bufs[BATCH];
+    for (size_t i = 0; i < BATCH; ++i) {
+        morse_bench_payload(text[i], chars);
+        // Rotate the payload by i, so that the strings differ.
+        for (size_t j = 0; j < i % chars; ++j) {
+            const char c = text[i][0];
+            memmove(text[i], text[i] + 1, chars - 1);
+            text[i][chars - 1] = c;
+        }
+        s[i] = text[i];
+        bufs[i] = encoded[i];
+    }
+    uint64_t iterations = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        morse_bench_sink =
+                morse_encode_batch(bufs, s, BATCH, sizeof(encoded[0]));
+        iterations += BATCH;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"encode_batch\",\"chars\":%zu,"
+           "\"iterations\":%llu,\"ns_per_op\":%.1f,\"chars_per_sec\":%.0f}\n",
+           chars,
+           (unsigned long long) iterations,
+           (double) elapsed / iterations,
+           (double) chars * iterations * 1e9 / elapsed);
+}
+
+/**
+ * \brief Time morse_ctx_send() cycling through a set of recurring
+ * messages, such as IDs and status codes, with or without a cache.
+ */
+static void morse_bench_rotation(const bool cached) {
+    enum {MESSAGES = MORSE_CACHE_LEN};
+    static char text[MESSAGES][17];
+    static morse_cache cache;
+    for (size_t i = 0; i < MESSAGES; ++i) {
+        morse_bench_payload(text[i], 16);
+        text[i][i % 16] = 'A' + i % 26;
+    }
+    morse_ctx_init(&morse_bench_ctx);
+    morse_cache_init(&cache);
+    if (cached) morse_bench_ctx.cache = &cache;
+    uint64_t iterations = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 64; ++i) {
+            morse_ctx_send(&morse_bench_ctx, text[i % MESSAGES], false);
+        }
+        iterations += 64;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"rotation\",\"cached\":%s,\"messages\":%d,"
+           "\"iterations\":%llu,\"ns_per_op\":%.1f}\n",
+           cached ? "true" : "false",
+           MESSAGES,
+           (unsigned long long) iterations,
+           (double) elapsed / iterations);
+}
+
+/**
+ * \brief Time morse_ctx_update() polled at a fixed tick, with 120 ms
+ * dots, on a repeating message.
+ *
+ * \param edges Whether to use edge_cb rather than cb.
+ */
+static void morse_bench_update(const bool edges, const uint32_t tick_ms) {
+    char s[65];
+    morse_bench_payload(s, 64);
+    morse_ctx_init(&morse_bench_ctx);
+    if (edges) {
+        morse_bench_ctx.edge_cb = morse_bench_edge_cb;
+    } else {
+        morse_bench_ctx.cb = morse_bench_cb;
+    }
+    morse_ctx_send(&morse_bench_ctx, s, true);
+    morse_bench_callbacks = 0;
+    uint64_t iterations = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 1024; ++i) {
+            morse_ctx_update(&morse_bench_ctx, tick_ms);
+        }
+        iterations += 1024;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"update\",\"mode\":\"%s\",\"tick_ms\":%u,"
+           "\"iterations\":%llu,\"ns_per_op\":%.1f,"
+           "\"callbacks_per_op\":%.3f}\n",
+           edges ? "edge" : "level",
+           tick_ms,
+           (unsigned long long) iterations,
+           (double) elapsed / iterations,
+           (double) morse_bench_callbacks / iterations);
+}
+
+/**
+ * \brief Time playback driven by morse_ctx_next_edge(), which issues
+ * one callback per edge, to get the cost of each callback.
+ */
+static void morse_bench_tickless(void) {
+    char s[65];
+    morse_bench_payload(s, 64);
+    morse_ctx_init(&morse_bench_ctx);
+    morse_bench_ctx.edge_cb = morse_bench_edge_cb;
+    morse_ctx_send(&morse_bench_ctx, s, true);
+    morse_bench_callbacks = 0;
+    uint64_t iterations = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 1024; ++i) {
+            morse_ctx_update(
+                    &morse_bench_ctx, morse_ctx_next_edge(&morse_bench_ctx));
+        }
+        iterations += 1024;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"tickless\",\"iterations\":%llu,"
+           "\"ns_per_op\":%.1f,\"ns_per_callback\":%.1f}\n",
+           (unsigned long long) iterations,
+           (double) elapsed / iterations,
+           (double) elapsed / morse_bench_callbacks);
+}
+
+/**
+ * \brief Time finding every edge of an encoded message with
+ * morse_edge(), as a renderer does. The message is long enough that
+ * its edges are not learnt by the branch predictor.
+ *
+ * \param silence Whether the message is mostly long runs of spaces,
+ *      rather than a random payload.
+ */
+static void morse_bench_edges(const bool silence) {
+    static char s[8193];
+    static uint8_t buf[16384];
+    morse_bench_payload(s, 8192);
+    for (size_t i = 0; silence && i < 8192; ++i) {
+        if (i % 64) s[i] = ' ';
+    }
+    morse_encode(buf, s, sizeof(buf));
+    const uint32_t len = morse_len(buf);
+    uint64_t iterations = 0;
+    uint64_t edges = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (uint32_t j = 0; j < len; j = morse_edge(buf, j, len)) ++edges;
+        ++iterations;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    morse_bench_sink = (uint32_t) edges;
+    printf("{\"bench\":\"edges\",\"message\":\"%s\",\"bits\":%u,"
+           "\"iterations\":%llu,\"ns_per_op\":%.1f,\"ns_per_edge\":%.1f}\n",
+           silence ? "silence" : "payload",
+           len,
+           (unsigned long long) iterations,
+           (double) elapsed / iterations,
+           (double) elapsed / edges);
+}
+
+/**
+ * \brief Time morse_ctx_update() with cb, at a tick of up to many plays,
+ * on a short repeating message that fits in the loop cache.
+ */
+static void morse_bench_beacon(const uint32_t tick_ms) {
+    char s[17];
+    morse_bench_payload(s, 16);
+    morse_ctx_init(&morse_bench_ctx);
+    morse_bench_ctx.cb = morse_bench_cb;
+    morse_ctx_send(&morse_bench_ctx, s, true);
+    morse_ctx_update(&morse_bench_ctx, 0);
+    morse_bench_callbacks = 0;
+    uint64_t iterations = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 1024; ++i) {
+            morse_ctx_update(&morse_bench_ctx, tick_ms);
+        }
+        iterations += 1024;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"beacon\",\"tick_ms\":%u,\"cached\":%s,"
+           "\"iterations\":%llu,\"ns_per_op\":%.1f}\n",
+           tick_ms,
+           morse_bench_ctx.loop_len ? "true" : "false",
+           (unsigned long long) iterations,
+           (double) elapsed / iterations);
+}
+
+/**
+ * \brief Time a tick of MORSE_SCHED_LEN channels, each repeating a
+ * message at its own speed, by morse_update_all() or by a morse_sched.
+ *
+ * \param sched Whether to use a morse_sched rather than
+ *      morse_update_all().
+ */
+static void morse_bench_channels(const bool sched, const uint32_t tick_ms) {
+    char s[65];
+    morse_bench_payload(s, 64);
+    morse_sched_init(&morse_bench_sched);
+    for (size_t i = 0; i < MORSE_SCHED_LEN; ++i) {
+        morse_ctx *const ctx = &morse_bench_ctxs[i];
+        morse_ctx_init(ctx);
+        ctx->edge_cb = morse_bench_edge_cb;
+        ctx->timing = morse_wpm(10 + i % 16, 0);
+        morse_ctx_send(ctx, s, true);
+        if (sched) morse_sched_add(&morse_bench_sched, ctx);
+    }
+    morse_bench_callbacks = 0;
+    uint64_t iterations = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (int i = 0; i < 64; ++i) {
+            if (sched) {
+                morse_sched_update(&morse_bench_sched, tick_ms);
+            } else {
+                morse_update_all(
+                        morse_bench_ctxs, MORSE_SCHED_LEN, tick_ms);
+            }
+        }
+        iterations += 64;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"channels\",\"mode\":\"%s\",\"channels\":%d,"
+           "\"tick_ms\":%u,\"iterations\":%llu,\"ns_per_op\":%.1f,"
+           "\"callbacks_per_op\":%.3f}\n",
+           sched ? "sched" : "update_all",
+           MORSE_SCHED_LEN,
+           tick_ms,
+           (unsigned long long) iterations,
+           (double) elapsed / iterations,
+           (double) morse_bench_callbacks / iterations);
+}
+
+
+/**
+ * \brief Time morse_pipeline_init() and morse_pipeline_encode() on a
+ * text of 16 MB, as for a corpus, and check the message against that
+ * encoded by one thread.
+ */
+static void morse_bench_pipeline(const unsigned threads) {
+    enum {CHARS = 16 << 20};
+    char *const s = malloc(CHARS + 1);
+    morse_pipeline pipeline;
+    if (!s) return;
+    morse_bench_payload(s, CHARS);
+    const uint32_t size =
+            morse_pipeline_init(&pipeline, s, CHARS, MORSE_POLICY_ERROR, 1);
+    uint8_t *const expected = size ? malloc(size) : NULL;
+    uint8_t *const buf = size ? malloc(size) : NULL;
+    if (!expected || !buf) {
+        morse_pipeline_free(&pipeline);
+        free(buf);
+        free(expected);
+        free(s);
+        return;
+    }
+    morse_pipeline_encode(&pipeline, expected, size);
+    morse_pipeline_free(&pipeline);
+    uint64_t iterations = 0;
+    uint64_t best = UINT64_MAX;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        const uint64_t run_start = MORSE_BENCH_NOW_NS();
+        morse_pipeline_init(&pipeline, s, CHARS, MORSE_POLICY_ERROR, threads);
+        morse_bench_sink = morse_pipeline_encode(&pipeline, buf, size);
+        morse_pipeline_free(&pipeline);
+        const uint64_t run = MORSE_BENCH_NOW_NS() - run_start;
+        if (run < best) best = run;
+        ++iterations;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"pipeline\",\"threads\":%u,\"chars\":%d,"
+           "\"iterations\":%llu,\"best_ms\":%.1f,\"chars_per_sec\":%.0f}\n",
+           threads,
+           CHARS,
+           (unsigned long long) iterations,
+           best / 1e6,
+           (double) CHARS * 1e9 / best);
+    char name[32];
+    snprintf(name, sizeof(name), "pipeline_%u_threads", threads);
+    morse_bench_check(name, morse_bench_same(buf, expected));
+    free(buf);
+    free(expected);
+    free(s);
+}
+
+/**
+ * \brief Make the random strings run on each backend, encoded by
+ * morse_encode() as expected.
+ *
+ * Strings are of up to MORSE_MAX_LEN characters, so that many do not
+ * fit in MORSE_MAX_LEN bytes, and one in four holds characters without
+ * a pattern. The same strings are made on every run.
+ */
+static void morse_bench_cases_init(void) {
+    uint32_t state = 67890;
+    for (size_t i = 0; i < MORSE_BENCH_CASES; ++i) {
+        char *const s = morse_bench_cases[i];
+        state = state * 1103515245 + 12345;
+        morse_bench_random(s, (state >> 8) % (MORSE_MAX_LEN + 1), &state);
+        const size_t n = strlen(s);
+        state = state * 1103515245 + 12345;
+        if (n && (state >> 16) % 4 == 0) s[(state >> 8) % n] = '#';
+        uint8_t *const expected = morse_bench_expected[i];
+        morse_bench_encoded[i] = morse_encode(expected, s, MORSE_MAX_LEN);
+        // The size needed is as reported, whether or not it fits.
+        const uint32_t size =
+                morse_encoded_size(s, MORSE_FORMAT_BITS, MORSE_POLICY_ERROR);
+        if (morse_bench_encoded[i] != (size && size <= MORSE_MAX_LEN)) {
+            fprintf(stderr, "Case %zu has encoded size %u.", i, size);
+            morse_bench_failed = true;
+        }
+    }
+}
+
+/**
+ * \brief Check a backend against morse_encode() on each random string
+ * and time it on them, including those it does not encode.
+ *
+ * Reports the throughput over all strings, and the worst time taken by
+ * any one string.
+ */
+static void morse_bench_backend_run(const morse_bench_backend *backend) {
+    static uint8_t buf[MORSE_MAX_LEN];
+    morse_ctx_init(&morse_bench_ctx);
+    uint32_t mismatches = 0;
+    for (size_t i = 0; i < MORSE_BENCH_CASES; ++i) {
+        const uint8_t *const got =
+                backend->encode(buf, morse_bench_cases[i]);
+        const bool same = got ? morse_bench_encoded[i]
+                && morse_bench_same(got, morse_bench_expected[i])
+                : !morse_bench_encoded[i];
+        if (!same) ++mismatches;
+    }
+    if (mismatches) morse_bench_failed = true;
+    uint64_t iterations = 0;
+    uint64_t chars = 0;
+    uint64_t worst = 0;
+    const uint64_t start = MORSE_BENCH_NOW_NS();
+    uint64_t elapsed;
+    do {
+        for (size_t i = 0; i < MORSE_BENCH_CASES; ++i) {
+            const char *const s = morse_bench_cases[i];
+            const uint64_t run_start = MORSE_BENCH_NOW_NS();
+            morse_bench_sink = backend->encode(buf, s) != NULL;
+            const uint64_t run = MORSE_BENCH_NOW_NS() - run_start;
+            if (run > worst) worst = run;
+            chars += strlen(s);
+        }
+        iterations += MORSE_BENCH_CASES;
+        elapsed = MORSE_BENCH_NOW_NS() - start;
+    } while (elapsed < morse_bench_min_ns);
+    printf("{\"bench\":\"backend\",\"backend\":\"%s\",\"cases\":%d,"
+           "\"mismatches\":%u,\"iterations\":%llu,\"ns_per_op\":%.1f,"
+           "\"worst_ns\":%llu,\"chars_per_sec\":%.0f}\n",
+           backend->name,
+           MORSE_BENCH_CASES,
+           mismatches,
+           (unsigned long long) iterations,
+           (double) elapsed / iterations,
+           (unsigned long long) worst,
+           (double) chars * 1e9 / elapsed);
+}
+
+/**
+ * \brief Check that seeking past the end of a message that does not
+ * repeat ends it, and the next starts on time.
+ *
+ * The time past the end was once kept, and carried into the next
+ * message, so that its edges were reported some 2^32 ms early.
+ */
+static void morse_bench_check_seek(void) {
+    morse_bench_log_init(&morse_bench_ctx);
+    morse_ctx_send(&morse_bench_ctx, "E", false);
+    morse_ctx_update(&morse_bench_ctx, 0);
+    const bool live = morse_ctx_seek(&morse_bench_ctx, 5000);
+    morse_ctx_send(&morse_bench_ctx, "E", false);
+    morse_bench_play(&morse_bench_ctx, 10);
+    // The first message ends at once, and the second is on from 3 to 4.
+    morse_bench_check("seek_past_end", live && morse_bench_log_len == 2
+            && morse_bench_log[0] == 3 * 2 + 1
+            && morse_bench_log[1] == 4 * 2);
+}
+
+/**
+ * \brief Check that messages ending within one update have their edges
+ * at the same times, and in order, however long the update.
+ *
+ * Each streamed character is a message of its own. Edges after the
+ * first message to end in an update were once reported at the start
+ * of the update, out of order.
+ */
+static void morse_bench_check_ends(void) {
+    static const uint32_t ticks[] = {1, 7, 50};
+    uint32_t expected[MORSE_BENCH_LOG];
+    size_t expected_len = 0;
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); ++i) {
+        morse_bench_log_init(&morse_bench_ctx);
+        morse_ctx_stream(&morse_bench_ctx, "EET", 3);
+        morse_ctx_update(&morse_bench_ctx, 0);
+        morse_bench_play(&morse_bench_ctx, ticks[i]);
+        for (size_t j = 1; j < morse_bench_log_len; ++j) {
+            if (morse_bench_log[j] / 2 < morse_bench_log[j - 1] / 2) {
+                ok = false;
+            }
+        }
+        if (!i) {
+            expected_len = morse_bench_log_len;
+            memcpy(expected, morse_bench_log, sizeof(expected));
+        } else if (morse_bench_log_len != expected_len || memcmp(
+                expected, morse_bench_log,
+                expected_len * sizeof(expected[0]))) {
+            ok = false;
+        }
+    }
+    // An edge either side of each element.
+    morse_bench_check("ends_in_update", ok && expected_len == 6);
+}
+
+/**
+ * \brief Check that a message appended to in parts, some while it
+ * plays, plays the same edges as the whole text sent at once.
+ *
+ * "K>" is appended while "<S" plays, so carries on its prosign from
+ * the other buffer, and " E" once "K>" has started.
+ */
+static void morse_bench_check_append(void) {
+    static const char *const parts[] = {"<S", "K>", " E"};
+    uint32_t expected[MORSE_BENCH_LOG];
+    size_t expected_len = 0;
+    bool ok = true;
+    for (int appended = 0; appended < 2; ++appended) {
+        morse_bench_log_init(&morse_bench_ctx);
+        if (appended) {
+            morse_ctx_append(&morse_bench_ctx, parts[0]);
+        } else {
+            morse_ctx_send(&morse_bench_ctx, "<SK> E", false);
+        }
+        morse_ctx_update(&morse_bench_ctx, 0);
+        for (size_t i = 1; i < sizeof(parts) / sizeof(parts[0]); ++i) {
+            for (uint32_t ms = 0; ms < 6; ++ms) {
+                morse_ctx_update(&morse_bench_ctx, 1);
+                ++morse_bench_log_ms;
+            }
+            if (appended && !morse_ctx_append(&morse_bench_ctx, parts[i])) {
+                ok = false;
+            }
+        }
+        if (appended) morse_ctx_append_end(&morse_bench_ctx);
+        morse_bench_play(&morse_bench_ctx, 1);
+        if (!appended) {
+            expected_len = morse_bench_log_len;
+            memcpy(expected, morse_bench_log, sizeof(expected));
+        } else if (morse_bench_log_len != expected_len || memcmp(
+                expected, morse_bench_log,
+                expected_len * sizeof(expected[0]))) {
+            ok = false;
+        }
+    }
+    // S and K joined, and E, have 7 elements in all.
+    morse_bench_check("append_while_playing", ok && expected_len == 14);
+}
+
+/**
+ * \brief Check that each random string sent as MORSE_FORMAT_RUNS plays
+ * the same edges as when sent as MORSE_FORMAT_BITS.
+ *
+ * The two are not comparable bit for bit, so are compared by what is
+ * played, at a Farnsworth timing so that gaps between characters are
+ * told apart from those within them. Strings that do not fit either
+ * format are left out.
+ */
+static void morse_bench_check_runs(void) {
+    uint32_t compared = 0;
+    bool ok = true;
+    for (size_t i = 0; i < MORSE_BENCH_CASES; ++i) {
+        const char *const s = morse_bench_cases[i];
+        const uint32_t size =
+                morse_encoded_size(s, MORSE_FORMAT_RUNS, MORSE_POLICY_ERROR);
+        if (!morse_bench_encoded[i] || !size || size > MORSE_MAX_LEN) {
+            continue;
+        }
+        uint32_t edges = 0;
+        uint32_t hash = 0;
+        for (int runs = 0; runs < 2; ++runs) {
+            morse_bench_log_init(&morse_bench_ctx);
+            morse_bench_ctx.timing = (morse_timing) {2, 3};
+            morse_bench_ctx.format =
+                    runs ? MORSE_FORMAT_RUNS : MORSE_FORMAT_BITS;
+            morse_ctx_send(&morse_bench_ctx, s, false);
+            morse_ctx_update(&morse_bench_ctx, 0);
+            morse_bench_play(&morse_bench_ctx, 10);
+            if (runs && (morse_bench_log_edges != edges
+                    || morse_bench_log_hash != hash)) {
+                ok = false;
+            }
+            edges = morse_bench_log_edges;
+            hash = morse_bench_log_hash;
+        }
+        ++compared;
+    }
+    morse_bench_check("runs_edges", ok && compared);
+}
+
+/**
+ * \brief Check that a text of many chunks, encoded by a morse_pipeline
+ * on several threads, matches morse_encode().
+ *
+ * The random strings are single chunks, as a chunk is at least
+ * MORSE_PIPELINE_CHUNK bytes, so this checks the bytes shared by
+ * chunks, including within prosigns left open across them. A text
+ * with a character without a pattern must fail as it does.
+ */
+static void morse_bench_check_pipeline(void) {
+    char *const s = malloc(MORSE_BENCH_CORPUS + 1);
+    uint32_t state = 24680;
+    if (s) morse_bench_random(s, MORSE_BENCH_CORPUS, &state);
+    const uint32_t size = s ? morse_encoded_size(
+            s, MORSE_FORMAT_BITS, MORSE_POLICY_ERROR) : 0;
+    uint8_t *const expected = size ? malloc(size) : NULL;
+    uint8_t *const buf = size ? malloc(size) : NULL;
+    bool ok = expected && buf && morse_encode(expected, s, size);
+    static const unsigned threads[] = {1, 2, 3, 4};
+    for (size_t i = 0; ok && i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        morse_pipeline pipeline;
+        const uint32_t got = morse_pipeline_init(
+                &pipeline, s, MORSE_BENCH_CORPUS, MORSE_POLICY_ERROR,
+                threads[i]);
+        ok = got == size && pipeline.len > threads[i]
+                && morse_pipeline_encode(&pipeline, buf, size) == size
+                && morse_bench_same(buf, expected);
+        morse_pipeline_free(&pipeline);
+    }
+    if (ok) {
+        s[MORSE_BENCH_CORPUS / 2] = '#';
+        morse_pipeline pipeline;
+        ok = !morse_pipeline_init(&pipeline, s, MORSE_BENCH_CORPUS,
+                        MORSE_POLICY_ERROR, 4)
+                && !morse_encode(buf, s, size);
+        morse_pipeline_free(&pipeline);
+    }
+    morse_bench_check("pipeline_chunks", ok);
+    free(buf);
+    free(expected);
+    free(s);
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Encode s with morse_encode(), the reference for the others.
+ */
+static const uint8_t *morse_bench_by_encode(uint8_t *buf, const char *s) {
+    return morse_encode(buf, s, MORSE_MAX_LEN) ? buf : NULL;
+}
+
+/**
+ * \brief Encode s with morse_ctx_send(), into the buffers of a context.
+ */
+static const uint8_t *morse_bench_by_send(uint8_t *buf, const char *s) {
+    (void) buf;
+    morse_ctx_send(&morse_bench_ctx, s, false);
+    return morse_bench_ctx.next_buf;
+}
+
+/**
+ * \brief Encode s with morse_encode_batch(), as a batch of one.
+ */
+static const uint8_t *morse_bench_by_batch(uint8_t *buf, const char *s) {
+    return morse_encode_batch(&buf, &s, 1, MORSE_MAX_LEN) ? buf : NULL;
+}
+
+/**
+ * \brief Encode s with a morse_pipeline of one thread, so that its
+ * latency is not that of starting threads.
+ */
+static const uint8_t *morse_bench_by_pipeline(uint8_t *buf, const char *s) {
+    morse_pipeline pipeline;
+    morse_pipeline_init(&pipeline, s, strlen(s), MORSE_POLICY_ERROR, 1);
+    const uint32_t size = morse_pipeline_encode(&pipeline, buf, MORSE_MAX_LEN);
+    morse_pipeline_free(&pipeline);
+    return size ? buf : NULL;
+}
+
+/**
+ * \brief Encode s with morse_ctx_append(), in parts of 1 to 16
+ * characters, into a new message of a context.
+ */
+static const uint8_t *morse_bench_by_append(uint8_t *buf, const char *s) {
+    (void) buf;
+    morse_ctx_init(&morse_bench_ctx);
+    const size_t n = strlen(s);
+    char part[17];
+    for (size_t i = 0, len = 0; i < n; i += len) {
+        len = 1 + (i * 7) % 16;
+        if (len > n - i) len = n - i;
+        memcpy(part, s + i, len);
+        part[len] = '\0';
+        if (!morse_ctx_append(&morse_bench_ctx, part)) return NULL;
+    }
+    // An empty string is still a message, of its padding.
+    if (!n && !morse_ctx_append(&morse_bench_ctx, "")) return NULL;
+    morse_ctx_append_end(&morse_bench_ctx);
+    return morse_bench_ctx.next_buf;
+}
+
+
+// --------------------------------------------------------------------
+
+
+#ifdef MORSE_BENCH_CLOCK_GETTIME
+static uint64_t morse_bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif  // MORSE_BENCH_CLOCK_GETTIME
+
+/**
+ * \brief Fill s with n pseudo-random letters, digits and spaces, and
+ * a null terminator. The same text is produced on every run.
+ */
+static void morse_bench_payload(char *s, const size_t n) {
+    static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789     ";
+    uint32_t state = 12345;
+    for (size_t i = 0; i < n; ++i) {
+        state = state * 1103515245 + 12345;
+        s[i] = chars[(state >> 16) % (sizeof(chars) - 1)];
+    }
+    s[n] = '\0';
+}
+
+/**
+ * \brief Fill s with n random characters from state, including
+ * lowercase, punctuation and prosigns, and a null terminator.
+ */
+static void morse_bench_random(char *s, const size_t n, uint32_t *state) {
+    static const char chars[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+            "0123456789.,?/=+-      <SK><AR> <";
+    for (size_t i = 0; i < n; ++i) {
+        *state = *state * 1103515245 + 12345;
+        s[i] = chars[(*state >> 16) % (sizeof(chars) - 1)];
+    }
+    s[n] = '\0';
+}
+
+/**
+ * \brief Whether two encoded messages have the same bits.
+ */
+static bool morse_bench_same(const uint8_t *a, const uint8_t *b) {
+    const uint32_t len = morse_len(a);
+    return len == morse_len(b) && !memcmp(a, b, 4 + (len + 7) / 8);
+}
+
+/**
+ * \brief Keep each edge in morse_bench_log, at its time since the
+ * context was first updated by morse_bench_play(), and hash it.
+ */
+static void morse_bench_log_cb(
+        morse_ctx *ctx, bool value, uint32_t offset_ms) {
+    (void) ctx;
+    const uint32_t edge = (morse_bench_log_ms + offset_ms) * 2 + value;
+    morse_bench_log_hash = (morse_bench_log_hash ^ edge) * 16777619;
+    ++morse_bench_log_edges;
+    if (morse_bench_log_len == MORSE_BENCH_LOG) return;
+    morse_bench_log[morse_bench_log_len++] = edge;
+}
+
+/**
+ * \brief Prepare ctx to play at one ms per dot duration, keeping its
+ * edges with morse_bench_log_cb() from a time of zero.
+ */
+static void morse_bench_log_init(morse_ctx *ctx) {
+    morse_ctx_init(ctx);
+    ctx->timing = (morse_timing) {1, 1};
+    ctx->edge_cb = morse_bench_log_cb;
+    morse_bench_log_len = 0;
+    morse_bench_log_edges = 0;
+    morse_bench_log_hash = 2166136261u;
+    morse_bench_log_ms = 0;
+}
+
+/**
+ * \brief Update ctx by tick_ms at a time until it has nothing to play.
+ */
+static void morse_bench_play(morse_ctx *ctx, const uint32_t tick_ms) {
+    while (morse_ctx_next_edge(ctx) != MORSE_NO_EDGE &&
+            morse_bench_log_ms < 1000000) {
+        morse_ctx_update(ctx, tick_ms);
+        morse_bench_log_ms += tick_ms;
+    }
+}
+
+/**
+ * \brief Report a check, failing the run if it did not pass.
+ */
+static void morse_bench_check(const char *name, const bool ok) {
+    printf("{\"bench\":\"check\",\"check\":\"%s\",\"ok\":%s}\n",
+           name, ok ? "true" : "false");
+    if (!ok) morse_bench_failed = true;
+}
+
+static void morse_bench_cb(morse_ctx *ctx, bool value) {
+    (void) ctx;
+    morse_bench_sink = value;
+    ++morse_bench_callbacks;
+}
+
+static void morse_bench_edge_cb(
+        morse_ctx *ctx, bool value, uint32_t offset_ms) {
+    (void) ctx;
+    morse_bench_sink = value + offset_ms;
+    ++morse_bench_callbacks;
+}
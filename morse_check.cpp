@@ -0,0 +1,134 @@
+/**
+ * Checks of the compile-time encoder of morse.hpp against
+ * morse_encode().
+ *
+ * Build with the library, for example:
+ *   cc -O2 -c morse.c && c++ -std=c++20 -O2 morse_check.cpp morse.o \
+ *           -o morse_check
+ *
+ * Each message defined with MORSE_MESSAGE() must hold the bytes that
+ * morse_encode() writes for its text, and both must reject the same
+ * characters. Results are printed as "check" lines, as by morse_bench,
+ * and the run fails if any check does. Strings morse_encode() rejects
+ * are reported on stderr, which may be discarded.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include "morse.h"
+#include "morse.hpp"
+
+
+namespace {
+
+/**
+ * \brief Whether Text is accepted by MORSE_MESSAGE(), which is only a
+ * constant expression if every character has a pattern.
+ */
+template <const char *Text>
+concept encodable = requires {
+    typename std::integral_constant<
+            std::uint32_t, ::morse_cx::encoded_len(Text)>;
+};
+
+// Covers prosigns, including a space and a stray '<' within one,
+// lower case, punctuation, Latin-1 letters, and the empty message.
+#define MORSE_CHECK_MESSAGES(X)                                        \
+    X(empty, "")                                                       \
+    X(e, "E")                                                          \
+    X(sos, "SOS")                                                      \
+    X(paris, "PARIS PARIS ")                                           \
+    X(lower, "cq cq de n0call k")                                      \
+    X(sk, "<SK>")                                                      \
+    X(prosigns, "<SK> <AR> K")                                         \
+    X(spaced, "<S K>")                                                 \
+    X(open, "A<B<C>D")                                                 \
+    X(punctuation, "HELLO, WORLD? 73! \"@$&;_'()=+-/.:")              \
+    X(latin, "\xC4\xD6\xDC \xE4\xF6\xFC \xC9\xD1")
+
+#define MORSE_CHECK_DEFINE(name, text) MORSE_MESSAGE(name, text);
+MORSE_CHECK_MESSAGES(MORSE_CHECK_DEFINE)
+#undef MORSE_CHECK_DEFINE
+
+/**
+ * \brief Message encoded at compile time, and its text.
+ */
+struct message {
+    const char *name;
+    const char *text;
+    const std::uint8_t *data;
+    std::size_t size;
+};
+
+#define MORSE_CHECK_ENTRY(name, text) \
+    {#name, text, name.data(), name.size()},
+constexpr message messages[] = {MORSE_CHECK_MESSAGES(MORSE_CHECK_ENTRY)};
+#undef MORSE_CHECK_ENTRY
+
+constexpr char valid[] = "CQ <SK> DE";
+constexpr char invalid_hash[] = "CQ # DE";
+constexpr char invalid_brace[] = "{";
+constexpr char invalid_control[] = "A\tB";
+static_assert(encodable<valid>);
+static_assert(encodable<invalid_hash> == false);
+static_assert(encodable<invalid_brace> == false);
+static_assert(encodable<invalid_control> == false);
+
+bool failed = false;
+
+/**
+ * \brief Report a check, failing the run if it did not pass.
+ */
+void check(const char *name, const bool ok) {
+    std::printf("{\"bench\":\"check\",\"check\":\"%s\",\"ok\":%s}\n",
+                name, ok ? "true" : "false");
+    if (!ok) failed = true;
+}
+
+/**
+ * \brief Check each message against morse_encode() of its text, into a
+ * buffer of its size, and one byte less, which must be rejected.
+ */
+void check_messages() {
+    for (const message &m : messages) {
+        std::uint8_t buf[256] = {0};
+        const std::uint32_t size = static_cast<std::uint32_t>(m.size);
+        const bool fits = size <= sizeof(buf)
+                && morse_encode(buf, m.text, size)
+                && !std::memcmp(buf, m.data, m.size)
+                && morse_encoded_size(
+                        m.text, MORSE_FORMAT_BITS, MORSE_POLICY_ERROR)
+                        == size;
+        check(m.name, fits && !morse_encode(buf, m.text, size - 1));
+    }
+}
+
+/**
+ * \brief Check that the characters the compile-time encoder has a
+ * pattern for are those morse_encode() accepts, for every byte.
+ */
+void check_chars() {
+    bool ok = true;
+    for (unsigned c = 1; c < 256; ++c) {
+        const char s[2] = {static_cast<char>(c), '\0'};
+        const bool delimiter = c == '<' || c == '>';
+        const bool known =
+                delimiter || ::morse_cx::lookup(s[0]).len != 0;
+        std::uint8_t buf[16];
+        if (known != morse_encode(buf, s, sizeof(buf))) ok = false;
+    }
+    std::uint8_t buf[64];
+    check("chars", ok && !morse_encode(buf, invalid_hash, sizeof(buf)));
+}
+
+}  // namespace
+
+
+int main() {
+    check_messages();
+    check_chars();
+    return failed;
+}
@@ -0,0 +1,403 @@
+/**
+ * Command-line renderer of text to timing files, at file speed rather
+ * than in real time.
+ *
+ * Build with the library, for example:
+ *   cc -O2 morse.c morse_render.c morse_tone.c morse_cli.c -o morse_cli
+ *
+ * Usage:
+ *   morse_cli [-f wav|csv|raw] [-o out] [-w wpm] [-s farnsworth_wpm]
+ *             [-r sample_rate_hz] [-t tone_hz] [-a ramp_ms]
+ *             [-p skip|substitute] [file...]
+ *
+ * Reads text from each file, which is memory mapped, or from stdin if
+ * there are none or a file is "-", and plays it as one stream through
+ * a context, updated from one edge straight to the next. Writes:
+ *   wav  16 bit mono PCM of the tone, with shaped keying.
+ *   csv  Time in ms and level of each edge, one per line.
+ *   raw  Signal sampled at the sample rate, 8 samples per byte, first
+ *        sample in the most significant bit.
+ * Output is written a block at a time as the text is played, so any
+ * length of input is rendered in constant memory. Line breaks and
+ * tabs are played as spaces. Needs a POSIX host.
+ */
+#include "morse.h"
+#include "morse_tone.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// --------------------------------------------------------------------
+
+
+// Bytes of text read, and samples rendered, at once.
+#define MORSE_CLI_BLOCK 4096
+
+typedef enum {
+    MORSE_CLI_WAV,
+    MORSE_CLI_CSV,
+    MORSE_CLI_RAW,
+} morse_cli_format;
+
+// State of a render, from the text played to the file written.
+typedef struct {
+    morse_ctx ctx;
+    uint64_t now_ms;  // Time of the start of the last update.
+    morse_cli_format format;
+    FILE *out;
+    uint32_t rate_hz;
+    bool level;  // Signal since last edge.
+    uint64_t samples;  // Rendered, for wav and raw.
+    uint32_t key[MORSE_CLI_BLOCK];  // Samples waiting to be written.
+    size_t keyed;  // Of key.
+    morse_tone tone;
+} morse_cli;
+
+
+// --------------------------------------------------------------------
+
+
+static bool morse_cli_file(morse_cli *cli, const char *path);
+static bool morse_cli_read(morse_cli *cli, int fd);
+static void morse_cli_text(morse_cli *cli, const char *s, size_t n);
+static bool morse_cli_step(morse_cli *cli);
+static void morse_cli_edge_cb(morse_ctx *ctx, bool value, uint32_t offset_ms);
+static void morse_cli_key(morse_cli *cli, uint64_t sample);
+static void morse_cli_flush(morse_cli *cli);
+static void morse_cli_finish(morse_cli *cli);
+static void morse_cli_wav_header(morse_cli *cli, uint64_t samples);
+static void morse_cli_put(uint8_t *p, uint32_t value, int bytes);
+static uint32_t morse_cli_number(const char *arg, const char *name);
+
+
+// --------------------------------------------------------------------
+
+
+int main(int argc, char **argv) {
+    static morse_cli cli;
+    uint32_t wpm = 20;
+    uint32_t farnsworth_wpm = 0;
+    uint32_t tone_hz = 600;
+    uint32_t ramp_ms = 5;
+    morse_policy policy = MORSE_POLICY_SKIP;
+    const char *out_path = NULL;
+    cli.format = MORSE_CLI_WAV;
+    cli.rate_hz = 8000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:o:w:s:r:t:a:p:")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (!strcmp(optarg, "wav")) {
+                cli.format = MORSE_CLI_WAV;
+            } else if (!strcmp(optarg, "csv")) {
+                cli.format = MORSE_CLI_CSV;
+            } else if (!strcmp(optarg, "raw")) {
+                cli.format = MORSE_CLI_RAW;
+            } else {
+                fprintf(stderr, "Invalid format: %s", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'w':
+            wpm = morse_cli_number(optarg, "speed");
+            break;
+        case 's':
+            farnsworth_wpm = morse_cli_number(optarg, "Farnsworth speed");
+            break;
+        case 'r':
+            cli.rate_hz = morse_cli_number(optarg, "sample rate");
+            break;
+        case 't':
+            tone_hz = morse_cli_number(optarg, "tone");
+            break;
+        case 'a':
+            ramp_ms = morse_cli_number(optarg, "ramp");
+            break;
+        case 'p':
+            if (!strcmp(optarg, "skip")) {
+                policy = MORSE_POLICY_SKIP;
+            } else if (!strcmp(optarg, "substitute")) {
+                policy = MORSE_POLICY_SUBSTITUTE;
+            } else {
+                fprintf(stderr, "Invalid policy: %s", optarg);
+                return 1;
+            }
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (!wpm || !cli.rate_hz ||
+            (cli.format == MORSE_CLI_WAV && tone_hz >= cli.rate_hz / 2)) {
+        fprintf(stderr, "Invalid speed, sample rate or tone.");
+        return 1;
+    }
+
+    cli.out = out_path ? fopen(out_path, "wb") : stdout;
+    if (!cli.out) {
+        perror(out_path);
+        return 1;
+    }
+    morse_ctx_init(&cli.ctx);
+    cli.ctx.user = &cli;
+    cli.ctx.edge_cb = morse_cli_edge_cb;
+    cli.ctx.timing = morse_wpm(wpm, farnsworth_wpm);
+    cli.ctx.policy = policy;
+    // The tone is keyed by the edges of the context, so plays no
+    // message of its own.
+    static const uint8_t empty[4] = {0};
+    morse_tone_init(&cli.tone, empty, cli.rate_hz, 1, tone_hz, ramp_ms);
+    cli.tone.amplitude = 0.5f;
+    if (cli.format == MORSE_CLI_WAV) {
+        morse_cli_wav_header(&cli, UINT32_MAX / 2);
+    } else if (cli.format == MORSE_CLI_CSV) {
+        fprintf(cli.out, "time_ms,level\n");
+    }
+
+    bool ok = true;
+    if (optind == argc) ok = morse_cli_read(&cli, STDIN_FILENO);
+    for (int i = optind; ok && i < argc; ++i) {
+        ok = !strcmp(argv[i], "-") ? morse_cli_read(&cli, STDIN_FILENO)
+                : morse_cli_file(&cli, argv[i]);
+    }
+    while (ok && morse_cli_step(&cli)) {}
+    if (ok) morse_cli_finish(&cli);
+    if (fflush(cli.out) || ferror(cli.out)) {
+        perror(out_path ? out_path : "stdout");
+        ok = false;
+    }
+    if (out_path) fclose(cli.out);
+    return ok ? 0 : 1;
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Play the text of a file, mapped into memory, or read if it
+ * cannot be.
+ */
+static bool morse_cli_file(morse_cli *cli, const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    bool ok = true;
+    if (map != MAP_FAILED) {
+        // Pages are only read once, in order.
+        madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+        morse_cli_text(cli, map, (size_t) st.st_size);
+        munmap(map, (size_t) st.st_size);
+    } else {
+        ok = morse_cli_read(cli, fd);
+    }
+    close(fd);
+    return ok;
+}
+
+/**
+ * \brief Play the text read from fd until its end.
+ */
+static bool morse_cli_read(morse_cli *cli, const int fd) {
+    static char buf[MORSE_CLI_BLOCK];
+    for (;;) {
+        const ssize_t n = read(fd, buf, sizeof(buf));
+        if (n == 0) return true;
+        if (n < 0) {
+            perror("read");
+            return false;
+        }
+        morse_cli_text(cli, buf, (size_t) n);
+    }
+}
+
+/**
+ * \brief Stream text to the context, playing it as the stream fills.
+ */
+static void morse_cli_text(morse_cli *cli, const char *s, size_t n) {
+    char block[MORSE_CLI_BLOCK];
+    while (n) {
+        const size_t m = n < sizeof(block) ? n : sizeof(block);
+        for (size_t i = 0; i < m; ++i) {
+            const char c = s[i];
+            block[i] = c == '\n' || c == '\r' || c == '\t' ? ' ' : c;
+        }
+        s += m;
+        n -= m;
+        // Characters are only refused while the stream is full, as the
+        // policy is never MORSE_POLICY_ERROR.
+        const char *p = block;
+        size_t left = m;
+        while (left) {
+            const size_t taken = morse_ctx_stream(&cli->ctx, p, left);
+            p += taken;
+            left -= taken;
+            if (left) morse_cli_step(cli);
+        }
+    }
+}
+
+/**
+ * \brief Update the context to its next edge.
+ *
+ * \return false once the context has nothing more to play.
+ */
+static bool morse_cli_step(morse_cli *cli) {
+    const uint32_t next_ms = morse_ctx_next_edge(&cli->ctx);
+    if (next_ms == MORSE_NO_EDGE) return false;
+    morse_ctx_update(&cli->ctx, next_ms);
+    cli->now_ms += next_ms;
+    return true;
+}
+
+static void morse_cli_edge_cb(
+        morse_ctx *ctx, const bool value, const uint32_t offset_ms) {
+    morse_cli *const cli = ctx->user;
+    const uint64_t time_ms = cli->now_ms + offset_ms;
+    if (cli->format == MORSE_CLI_CSV) {
+        fprintf(cli->out, "%llu,%d\n", (unsigned long long) time_ms, value);
+    } else {
+        // Each edge starts on the first sample at or after it.
+        morse_cli_key(cli, (time_ms * cli->rate_hz + 999) / 1000);
+    }
+    cli->level = value;
+}
+
+/**
+ * \brief Render the signal since the last edge up to sample.
+ */
+static void morse_cli_key(morse_cli *cli, const uint64_t sample) {
+    const uint32_t word = cli->level;
+    while (cli->samples < sample) {
+        uint64_t n = MORSE_CLI_BLOCK - cli->keyed;
+        if (n > sample - cli->samples) n = sample - cli->samples;
+        for (uint64_t i = 0; i < n; ++i) cli->key[cli->keyed++] = word;
+        cli->samples += n;
+        if (cli->keyed == MORSE_CLI_BLOCK) morse_cli_flush(cli);
+    }
+}
+
+/**
+ * \brief Write the samples waiting in key, as whole bytes if raw.
+ */
+static void morse_cli_flush(morse_cli *cli) {
+    if (cli->format == MORSE_CLI_WAV) {
+        int16_t pcm[MORSE_CLI_BLOCK] = {0};
+        morse_tone_keyed_s16(&cli->tone, cli->key, pcm, cli->keyed);
+        // Samples are little endian in the file.
+        uint8_t bytes[2 * MORSE_CLI_BLOCK];
+        for (size_t i = 0; i < cli->keyed; ++i) {
+            morse_cli_put(bytes + 2 * i, (uint16_t) pcm[i], 2);
+        }
+        fwrite(bytes, 2, cli->keyed, cli->out);
+        cli->keyed = 0;
+        return;
+    }
+    uint8_t bytes[MORSE_CLI_BLOCK / 8];
+    const size_t whole = cli->keyed / 8;
+    for (size_t i = 0; i < whole; ++i) {
+        uint8_t byte = 0;
+        for (size_t j = 0; j < 8; ++j) {
+            byte = (uint8_t) (byte << 1 | (cli->key[8 * i + j] != 0));
+        }
+        bytes[i] = byte;
+    }
+    fwrite(bytes, 1, whole, cli->out);
+    // A part byte waits for the next samples.
+    memmove(cli->key, cli->key + 8 * whole,
+            (cli->keyed - 8 * whole) * sizeof(cli->key[0]));
+    cli->keyed -= 8 * whole;
+}
+
+/**
+ * \brief Write the rest of the output once the text has been played.
+ *
+ * The tone is followed by the silence of a word gap, long enough for
+ * its last element to decay, and raw output is padded with off samples
+ * to a whole byte.
+ */
+static void morse_cli_finish(morse_cli *cli) {
+    if (cli->format == MORSE_CLI_CSV) return;
+    const morse_timing timing = cli->ctx.timing;
+    const uint64_t end_ms = cli->now_ms + 7 * (uint64_t) timing.gap_ms;
+    cli->level = false;
+    if (cli->format == MORSE_CLI_WAV) {
+        morse_cli_key(cli, (end_ms * cli->rate_hz + 999) / 1000);
+        morse_cli_flush(cli);
+        if (!fseek(cli->out, 0, SEEK_SET)) {
+            morse_cli_wav_header(cli, cli->samples);
+        }
+        return;
+    }
+    morse_cli_key(cli, (cli->samples + 7) / 8 * 8);
+    morse_cli_flush(cli);
+}
+
+/**
+ * \brief Write the header of a wav file holding samples, at the
+ * current position of the output.
+ *
+ * Unless the output can be rewound to correct it once the length is
+ * known, the length written is the largest a wav file may hold, which
+ * most readers take as unknown.
+ */
+static void morse_cli_wav_header(morse_cli *cli, uint64_t samples) {
+    if (samples > (UINT32_MAX - 36) / 2) samples = (UINT32_MAX - 36) / 2;
+    const uint32_t data_size = (uint32_t) samples * 2;
+    uint8_t h[44];
+    memcpy(h, "RIFF", 4);
+    morse_cli_put(h + 4, 36 + data_size, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    morse_cli_put(h + 16, 16, 4);  // Size of the format chunk.
+    morse_cli_put(h + 20, 1, 2);  // PCM.
+    morse_cli_put(h + 22, 1, 2);  // Channels.
+    morse_cli_put(h + 24, cli->rate_hz, 4);
+    morse_cli_put(h + 28, cli->rate_hz * 2, 4);  // Bytes per second.
+    morse_cli_put(h + 32, 2, 2);  // Bytes per frame.
+    morse_cli_put(h + 34, 16, 2);  // Bits per sample.
+    memcpy(h + 36, "data", 4);
+    morse_cli_put(h + 40, data_size, 4);
+    fwrite(h, 1, sizeof(h), cli->out);
+}
+
+/**
+ * \brief Store the low bytes of value at p, least significant first.
+ */
+static void morse_cli_put(uint8_t *p, uint32_t value, const int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        p[i] = (uint8_t) value;
+        value >>= 8;
+    }
+}
+
+/**
+ * \brief Parse a whole number option, exiting if it is not one.
+ */
+static uint32_t morse_cli_number(const char *arg, const char *name) {
+    char *end;
+    const unsigned long value = strtoul(arg, &end, 10);
+    if (!*arg || *end || value > UINT16_MAX * 1000UL) {
+        fprintf(stderr, "Invalid %s: %s", name, arg);
+        exit(1);
+    }
+    return (uint32_t) value;
+}
@@ -0,0 +1,204 @@
+#include "morse_decode.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// --------------------------------------------------------------------
+
+
+// Characters indexed by their packed pattern: a leading 1 bit,
+// followed by a bit per element, 0 for a dot and 1 for a dash.
+// Zero where no character has that pattern. Prosigns decode as the
+// punctuation sharing their pattern, such as '+' for <AR>, and
+// Latin-1 letters are not decoded.
+static const char chars[256] = {
+    [0x02] = 'E',  // .
+    [0x03] = 'T',  // -
+    [0x04] = 'I',  // ..
+    [0x05] = 'A',  // .-
+    [0x06] = 'N',  // -.
+    [0x07] = 'M',  // --
+    [0x08] = 'S',  // ...
+    [0x09] = 'U',  // ..-
+    [0x0A] = 'R',  // .-.
+    [0x0B] = 'W',  // .--
+    [0x0C] = 'D',  // -..
+    [0x0D] = 'K',  // -.-
+    [0x0E] = 'G',  // --.
+    [0x0F] = 'O',  // ---
+    [0x10] = 'H',  // ....
+    [0x11] = 'V',  // ...-
+    [0x12] = 'F',  // ..-.
+    [0x14] = 'L',  // .-..
+    [0x16] = 'P',  // .--.
+    [0x17] = 'J',  // .---
+    [0x18] = 'B',  // -...
+    [0x19] = 'X',  // -..-
+    [0x1A] = 'C',  // -.-.
+    [0x1B] = 'Y',  // -.--
+    [0x1C] = 'Z',  // --..
+    [0x1D] = 'Q',  // --.-
+    [0x20] = '5',  // .....
+    [0x21] = '4',  // ....-
+    [0x23] = '3',  // ...--
+    [0x27] = '2',  // ..---
+    [0x28] = '&',  // .-...
+    [0x2A] = '+',  // .-.-.
+    [0x2F] = '1',  // .----
+    [0x30] = '6',  // -....
+    [0x31] = '=',  // -...-
+    [0x32] = '/',  // -..-.
+    [0x36] = '(',  // -.--.
+    [0x38] = '7',  // --...
+    [0x3C] = '8',  // ---..
+    [0x3E] = '9',  // ----.
+    [0x3F] = '0',  // -----
+    [0x4C] = '?',  // ..--..
+    [0x4D] = '_',  // ..--.-
+    [0x52] = '"',  // .-..-.
+    [0x55] = '.',  // .-.-.-
+    [0x5A] = '@',  // .--.-.
+    [0x5E] = '\'', // .----.
+    [0x61] = '-',  // -....-
+    [0x6A] = ';',  // -.-.-.
+    [0x6B] = '!',  // -.-.--
+    [0x6D] = ')',  // -.--.-
+    [0x73] = ',',  // --..--
+    [0x78] = ':',  // ---...
+    [0x89] = '$',  // ...-..-
+};
+
+#define EMPTY_PATTERN 1
+
+
+// --------------------------------------------------------------------
+
+
+static void morse_decode_element(morse_decoder *decoder, uint32_t duration);
+static void morse_decode_gap(morse_decoder *decoder, uint32_t duration);
+static uint32_t morse_decode_adjust(uint32_t estimate, uint32_t target);
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Prepare a decoder for use.
+ *
+ * \param dot_duration Initial guess of the sender's dot duration, in
+ *      the same unit as the times passed later. The estimate follows
+ *      the sender's speed as elements are received.
+ */
+void morse_decoder_init(morse_decoder *decoder, uint32_t dot_duration) {
+    *decoder = (morse_decoder) {
+        .dot = dot_duration,
+        .dash = 3 * dot_duration,
+        .pattern = EMPTY_PATTERN,
+    };
+}
+
+/**
+ * \brief Feed a change of the received signal to the decoder.
+ *
+ * The reverse of morse_ctx::edge_cb. Decoded characters are passed to
+ * the decoder's cb as soon as the gap following them is recognized.
+ * Calls that do not change the signal are ignored. The first edge since
+ * morse_decoder_init() only starts the clock, as the signal has been
+ * off for an unknown time before it.
+ *
+ * \param value New signal.
+ * \param time Time of the change, in any unit, which may wrap around.
+ */
+void morse_decode_edge(morse_decoder *decoder, bool value, uint32_t time) {
+    if (value == decoder->level) return;
+    const uint32_t duration = time - decoder->last_time;
+    if (!decoder->started) {
+        decoder->started = true;
+    } else if (decoder->level) {
+        morse_decode_element(decoder, duration);
+    } else if (duration < 2 * decoder->dot) {
+        // Gaps between elements are a dot long even with Farnsworth
+        // timing, so they also refine the estimate.
+        decoder->dot = morse_decode_adjust(decoder->dot, duration);
+        decoder->dash = morse_decode_adjust(decoder->dash, decoder->dot * 3);
+    } else {
+        morse_decode_gap(decoder, duration);
+    }
+    decoder->level = value;
+    decoder->last_time = time;
+}
+
+/**
+ * \brief Pass on a character and space that have been completed by
+ * the signal staying off until time.
+ *
+ * Without this, the last character is only passed on when the
+ * following one starts. May be called as often as convenient.
+ */
+void morse_decode_poll(morse_decoder *decoder, uint32_t time) {
+    if (decoder->level || !decoder->started) return;
+    morse_decode_gap(decoder, time - decoder->last_time);
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Classify an element as a dot or dash and add it to the
+ * current character.
+ *
+ * Dot and dash estimates are tracked separately, and each pulls the
+ * other towards a 1:3 ratio, so that the threshold between them
+ * recovers from a poor initial guess even if only one kind of element
+ * is received for a while.
+ */
+static void morse_decode_element(morse_decoder *decoder, uint32_t duration) {
+    const bool dash = duration > (decoder->dot + decoder->dash) / 2;
+    if (dash) {
+        decoder->dash = morse_decode_adjust(decoder->dash, duration);
+        decoder->dot = morse_decode_adjust(decoder->dot, decoder->dash / 3);
+    } else {
+        decoder->dot = morse_decode_adjust(decoder->dot, duration);
+        decoder->dash = morse_decode_adjust(decoder->dash, decoder->dot * 3);
+    }
+    if (!decoder->pattern || decoder->pattern & 0x80) {
+        decoder->pattern = 0;  // Too many elements for any character.
+    } else {
+        decoder->pattern = (decoder->pattern << 1) | dash;
+    }
+}
+
+/**
+ * \brief Classify a gap in the signal, and pass on the current
+ * character if the gap ends it.
+ *
+ * A gap longer than two dots ends a character, and one longer than
+ * five dots ends a word.
+ */
+static void morse_decode_gap(morse_decoder *decoder, uint32_t duration) {
+    if (duration < 2 * decoder->dot) return;
+    if (decoder->pattern != EMPTY_PATTERN) {
+        const char c = chars[decoder->pattern];
+        if (c) {
+            if (decoder->cb) decoder->cb(decoder, c);
+            decoder->space = true;
+        } else {
+            ++decoder->errors;
+        }
+        decoder->pattern = EMPTY_PATTERN;
+    }
+    if (duration >= 5 * decoder->dot && decoder->space) {
+        if (decoder->cb) decoder->cb(decoder, ' ');
+        decoder->space = false;
+    }
+}
+
+/**
+ * \brief Move an estimate a quarter of the way towards target.
+ */
+static uint32_t morse_decode_adjust(uint32_t estimate, uint32_t target) {
+    if (target > estimate) return estimate + (target - estimate + 3) / 4;
+    return estimate - (estimate - target) / 4;
+}
@@ -0,0 +1,37 @@
+#ifndef MORSE_DECODE_H_
+#define MORSE_DECODE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct morse_decoder morse_decoder;
+
+/**
+ * \brief State of a decoder turning signal changes back into text.
+ *
+ * Uses a fixed amount of memory and a bounded amount of work per
+ * call, so it can be fed from an interrupt. Fields should be treated
+ * as private, other than cb and user, which may be set after
+ * morse_decoder_init().
+ */
+struct morse_decoder {
+    uint32_t dot;  // Estimated dot duration.
+    uint32_t dash;  // Estimated dash duration.
+    uint32_t last_time;  // Time of last edge.
+    uint32_t errors;  // Count of unrecognized characters.
+    uint8_t pattern;  // Elements received in current character.
+    bool level;  // Signal since last edge.
+    bool started;  // Whether an edge has been received, to time from.
+    bool space;  // Whether a space may follow the last character.
+    void (*cb)(morse_decoder *decoder, char c);
+    void *user;
+};
+
+
+void morse_decoder_init(morse_decoder *decoder, uint32_t dot_duration);
+void morse_decode_edge(morse_decoder *decoder, bool value, uint32_t time);
+void morse_decode_poll(morse_decoder *decoder, uint32_t time);
+
+
+#endif  // MORSE_DECODE_H_
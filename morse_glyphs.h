@@ -0,0 +1,95 @@
+#ifndef MORSE_GLYPHS_H_
+#define MORSE_GLYPHS_H_
+
+
+/**
+ * \brief List of encodable characters, for building lookup tables.
+ *
+ * Expands GLYPH(c, bits, len) for each character, and
+ * LETTER(c, bits, len) for each upper case letter, which should also
+ * be used for its lower case form. bits is the on/off pattern of the
+ * character, first dot duration in the least significant bit, and len
+ * the length of the pattern in dot durations.
+ *
+ * Covers the ITU set, the common non-ITU punctuation, and the letters
+ * of the ISO 8859-1 (Latin-1) extensions, by their Latin-1 byte, whose
+ * lower case form is also 0x20 above the upper case one. Prosigns are
+ * not listed, as they are sent as their letters without gaps.
+ *
+ * Each character starts with two empty dot durations, which combine
+ * with the empty dot duration at the start of each element to form
+ * the expected three-dot 'off' period between characters.
+ * A space is four dot durations of silence. Combined with the three
+ * spaces at the start of a character, forms the 7 dot durations of
+ * separation that are expected between words.
+ */
+#define MORSE_GLYPHS(GLYPH, LETTER)                   \
+    GLYPH(' ', 0x000000,  4)                          \
+    GLYPH('0', 0x3BBBB8, 22)   /* ----- */            \
+    GLYPH('1', 0x0EEEE8, 20)   /* .---- */            \
+    GLYPH('2', 0x03BBA8, 18)   /* ..--- */            \
+    GLYPH('3', 0x00EEA8, 16)   /* ...-- */            \
+    GLYPH('4', 0x003AA8, 14)   /* ....- */            \
+    GLYPH('5', 0x000AA8, 12)   /* ..... */            \
+    GLYPH('6', 0x002AB8, 14)   /* -.... */            \
+    GLYPH('7', 0x00ABB8, 16)   /* --... */            \
+    GLYPH('8', 0x02BBB8, 18)   /* ---.. */            \
+    GLYPH('9', 0x0BBBB8, 20)   /* ----. */            \
+    GLYPH('.', 0x0EBAE8, 20)   /* .-.-.- */           \
+    GLYPH(',', 0x3BABB8, 22)   /* --..-- */           \
+    GLYPH(':', 0x0ABBB8, 20)   /* ---... */           \
+    GLYPH('?', 0x02BBA8, 18)   /* ..--.. */           \
+    GLYPH('\'', 0x2EEEE8, 22)  /* .----. */           \
+    GLYPH('-', 0x03AAB8, 18)   /* -....- */           \
+    GLYPH('/', 0x00BAB8, 16)   /* -..-. */            \
+    GLYPH('(', 0x02EEB8, 18)   /* -.--. */            \
+    GLYPH(')', 0x3AEEB8, 22)   /* -.--.- */           \
+    GLYPH('"', 0x02EAE8, 18)   /* .-..-. */           \
+    GLYPH('=', 0x00EAB8, 16)   /* -...- */            \
+    GLYPH('+', 0x00BAE8, 16)   /* .-.-. */            \
+    GLYPH('@', 0x0BAEE8, 20)   /* .--.-. */           \
+    GLYPH('!', 0x3BAEB8, 22)   /* -.-.-- */           \
+    GLYPH('&', 0x002AE8, 14)   /* .-... */            \
+    GLYPH(';', 0x0BAEB8, 20)   /* -.-.-. */           \
+    GLYPH('_', 0x0EBBA8, 20)   /* ..--.- */           \
+    GLYPH('$', 0x0EAEA8, 20)   /* ...-..- */          \
+    LETTER('A', 0x0000E8,  8)  /* .- */               \
+    LETTER('B', 0x000AB8, 12)  /* -... */             \
+    LETTER('C', 0x002EB8, 14)  /* -.-. */             \
+    LETTER('D', 0x0002B8, 10)  /* -.. */              \
+    LETTER('E', 0x000008,  4)  /* . */                \
+    LETTER('F', 0x000BA8, 12)  /* ..-. */             \
+    LETTER('G', 0x000BB8, 12)  /* --. */              \
+    LETTER('H', 0x0002A8, 10)  /* .... */             \
+    LETTER('I', 0x000028,  6)  /* .. */               \
+    LETTER('J', 0x00EEE8, 16)  /* .--- */             \
+    LETTER('K', 0x000EB8, 12)  /* -.- */              \
+    LETTER('L', 0x000AE8, 12)  /* .-.. */             \
+    LETTER('M', 0x0003B8, 10)  /* -- */               \
+    LETTER('N', 0x0000B8,  8)  /* -. */               \
+    LETTER('O', 0x003BB8, 14)  /* --- */              \
+    LETTER('P', 0x002EE8, 14)  /* .--. */             \
+    LETTER('Q', 0x00EBB8, 16)  /* --.- */             \
+    LETTER('R', 0x0002E8, 10)  /* .-. */              \
+    LETTER('S', 0x0000A8,  8)  /* ... */              \
+    LETTER('T', 0x000038,  6)  /* - */                \
+    LETTER('U', 0x0003A8, 10)  /* ..- */              \
+    LETTER('V', 0x000EA8, 12)  /* ...- */             \
+    LETTER('W', 0x000EE8, 12)  /* .-- */              \
+    LETTER('X', 0x003AB8, 14)  /* -..- */             \
+    LETTER('Y', 0x00EEB8, 16)  /* -.-- */             \
+    LETTER('Z', 0x002BB8, 14)  /* --.. */             \
+    LETTER(0xC0, 0x03AEE8, 18) /* .--.- A grave */    \
+    LETTER(0xC4, 0x003AE8, 14) /* .-.- A diaeresis */ \
+    LETTER(0xC5, 0x03AEE8, 18) /* .--.- A ring */     \
+    LETTER(0xC7, 0x00AEB8, 16) /* -.-.. C cedilla */  \
+    LETTER(0xC8, 0x00EAE8, 16) /* .-..- E grave */    \
+    LETTER(0xC9, 0x002BA8, 14) /* ..-.. E acute */    \
+    LETTER(0xD1, 0x0EEBB8, 20) /* --.-- N tilde */    \
+    LETTER(0xD6, 0x00BBB8, 16) /* ---. O diaeresis */ \
+    LETTER(0xD8, 0x00BBB8, 16) /* ---. O stroke */    \
+    LETTER(0xDC, 0x003BA8, 14) /* ..-- U diaeresis */ \
+    GLYPH(0xDF, 0x0AEEA8, 20)  /* ...--.. sharp s */
+
+
+#endif  // MORSE_GLYPHS_H_
@@ -0,0 +1,117 @@
+#include "morse_host.h"
+
+#include "morse.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// --------------------------------------------------------------------
+
+
+static void morse_timer_arm(const morse_timer *timer, uint32_t us);
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Get the time on the monotonic clock of the host in us, for
+ * morse_ctx_update_us() and morse_ctx_next_edge_us(), wrapping.
+ */
+uint32_t morse_host_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/**
+ * \brief Prepare a timer for a context, which it plays from now on.
+ *
+ * The fd of the timer is readable at once, so that whatever the
+ * context already has to play is taken up on the first call to
+ * morse_timer_handle(). The context is updated with
+ * morse_ctx_update_us() from then on, which it must not be mixed with.
+ *
+ * \return Whether the timerfd could be created. If not, the timer is
+ *      not in use, but may still be passed to morse_timer_free().
+ */
+bool morse_timer_init(morse_timer *timer, morse_ctx *ctx) {
+    timer->ctx = ctx;
+    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    atomic_init(&timer->woken, false);
+    timer->user = NULL;
+    if (timer->fd < 0) {
+        fprintf(stderr, "Failed to create timer: %d", errno);
+        return false;
+    }
+    morse_timer_arm(timer, 0);
+    return true;
+}
+
+/**
+ * \brief Close the timerfd of a timer, once it is out of the loop.
+ */
+void morse_timer_free(morse_timer *timer) {
+    if (timer->fd >= 0) close(timer->fd);
+    timer->fd = -1;
+}
+
+/**
+ * \brief Have the loop handle a timer at once, after a call that may
+ * have brought the next edge of its context forward, such as
+ * morse_ctx_send() or morse_ctx_interrupt().
+ *
+ * May be called by the producer of the context, from any thread.
+ */
+void morse_timer_wake(morse_timer *timer) {
+    atomic_store_explicit(&timer->woken, true, memory_order_release);
+    morse_timer_arm(timer, 0);
+}
+
+/**
+ * \brief Update the context of a timer to now, reporting its edges,
+ * and arm the timer for its next edge.
+ *
+ * Called by the loop when the fd of the timer is readable, from the
+ * thread of the loop. A call when it is not does no harm.
+ */
+void morse_timer_handle(morse_timer *timer) {
+    uint64_t expirations;
+    while (read(timer->fd, &expirations, sizeof(expirations)) > 0) {
+        continue;
+    }
+    atomic_exchange_explicit(&timer->woken, false, memory_order_acquire);
+    const uint32_t now = morse_host_now_us();
+    morse_ctx_update_us(timer->ctx, now);
+    morse_timer_arm(timer, morse_ctx_next_edge_us(timer->ctx, now));
+    // A wake after the update may have been overwritten by arming for
+    // the edge, so is made again. One after this check arms afterwards.
+    if (atomic_load_explicit(&timer->woken, memory_order_acquire)) {
+        morse_timer_arm(timer, 0);
+    }
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Set the timerfd of a timer to expire in us, at once if us is
+ * 0, or never if it is MORSE_NO_EDGE.
+ */
+static void morse_timer_arm(const morse_timer *timer, const uint32_t us) {
+    struct itimerspec spec = {{0, 0}, {0, 0}};
+    if (us != MORSE_NO_EDGE) {
+        // An expiry of zero would disarm the timer instead.
+        spec.it_value.tv_sec = us / 1000000;
+        spec.it_value.tv_nsec = us ? (long) (us % 1000000) * 1000 : 1;
+    }
+    timerfd_settime(timer->fd, 0, &spec, NULL);
+}
@@ -0,0 +1,51 @@
+#ifndef MORSE_HOST_H_
+#define MORSE_HOST_H_
+
+#include "morse.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+
+/**
+ * \brief Timer driving one context from an event loop, such as one
+ * built on epoll, on a Linux host.
+ *
+ * Holds a timerfd, which becomes readable when the next edge of the
+ * context is due, so that any number of contexts can be played by one
+ * thread that sleeps until one of their fds is readable, and then
+ * passes the timer to morse_timer_handle(). A loop that keeps its own
+ * timers can instead sleep for morse_ctx_next_edge_us() on the clock
+ * of morse_host_now_us(). Many contexts on one fd are better served
+ * by a morse_sched.
+ *
+ * The loop thread is the consumer of the context. Producers call
+ * morse_timer_wake() after sending to, interrupting or stopping it,
+ * from any thread. Fields should be treated as private, other than
+ * user.
+ */
+typedef struct {
+    morse_ctx *ctx;
+    int fd;  // timerfd, or -1 if the timer is not in use.
+    MORSE_ATOMIC(bool) woken;  // Set by morse_timer_wake().
+    void *user;
+} morse_timer;
+
+
+uint32_t morse_host_now_us(void);
+bool morse_timer_init(morse_timer *timer, morse_ctx *ctx);
+void morse_timer_free(morse_timer *timer);
+void morse_timer_wake(morse_timer *timer);
+void morse_timer_handle(morse_timer *timer);
+
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif  // __cplusplus
+
+
+#endif  // MORSE_HOST_H_
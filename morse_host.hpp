@@ -0,0 +1,124 @@
+#ifndef MORSE_HOST_HPP_
+#define MORSE_HOST_HPP_
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+
+#include "morse.h"
+#include "morse_host.h"
+
+
+namespace morse_cx {
+
+/**
+ * \brief Change of the signal of a context, as passed to edge_cb.
+ */
+struct edge {
+    bool value;
+    std::uint32_t time_us;  // Exact, on the clock of morse_host_now_us().
+};
+
+/**
+ * \brief Coroutine that starts at once and runs until it returns, with
+ * nothing waiting for it, such as one keying a channel.
+ */
+struct task {
+    struct promise_type {
+        task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+/**
+ * \brief Player of a context from an event loop, whose edges a
+ * coroutine may await one at a time.
+ *
+ *   morse_cx::task key(morse_cx::player &player) {
+ *       for (;;) {
+ *           const morse_cx::edge edge = co_await player.next_edge();
+ *           set_pin(edge.value);
+ *       }
+ *   }
+ *
+ * The loop calls handle() whenever fd() is readable, which resumes the
+ * coroutine waiting on the player, on the thread of the loop, for each
+ * edge since the last call. Edges are kept until awaited, so none are
+ * lost while the coroutine waits on something else. Takes the edge_cb
+ * and user fields of the context, and must outlive any coroutine
+ * waiting on it. Producers call wake() as for morse_timer_wake().
+ * Needs C++20, and a host for morse_host.c.
+ */
+class player {
+  public:
+    class awaiter {
+      public:
+        explicit awaiter(player &owner) : owner_(owner) {}
+        bool await_ready() const noexcept { return !owner_.edges_.empty(); }
+        void await_suspend(const std::coroutine_handle<> waiting) noexcept {
+            owner_.waiting_ = waiting;
+        }
+        edge await_resume() noexcept {
+            const edge next = owner_.edges_.front();
+            owner_.edges_.pop_front();
+            return next;
+        }
+
+      private:
+        player &owner_;
+    };
+
+    explicit player(morse_ctx *ctx) {
+        ctx->edge_cb = &player::on_edge;
+        ctx->user = this;
+        ok_ = morse_timer_init(&timer_, ctx);
+    }
+    ~player() { morse_timer_free(&timer_); }
+    player(const player &) = delete;
+    player &operator=(const player &) = delete;
+
+    /**
+     * \brief Whether the timer of the player could be created.
+     */
+    explicit operator bool() const { return ok_; }
+    int fd() const { return timer_.fd; }
+    void wake() { morse_timer_wake(&timer_); }
+
+    /**
+     * \brief Update the context, and resume the coroutine waiting on
+     * the player while there are edges for it.
+     */
+    void handle() {
+        morse_timer_handle(&timer_);
+        while (waiting_ && !edges_.empty()) {
+            const std::coroutine_handle<> waiting = waiting_;
+            waiting_ = nullptr;
+            waiting.resume();
+        }
+    }
+
+    /**
+     * \brief Get an awaitable of the next edge of the context.
+     */
+    awaiter next_edge() { return awaiter(*this); }
+
+  private:
+    static void on_edge(morse_ctx *ctx, bool value, uint32_t offset_ms) {
+        player *const self = static_cast<player *>(ctx->user);
+        self->edges_.push_back({value, morse_ctx_edge_us(ctx, offset_ms)});
+    }
+
+    morse_timer timer_;
+    bool ok_ = false;
+    std::deque<edge> edges_;
+    std::coroutine_handle<> waiting_ = nullptr;
+};
+
+}  // namespace morse_cx
+
+
+#endif  // MORSE_HOST_HPP_
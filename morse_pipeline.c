@@ -0,0 +1,225 @@
+#include "morse_pipeline.h"
+
+#include "morse.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Pass over the chunks of a pipeline, shared by its threads.
+ */
+typedef struct {
+    morse_pipeline *pipeline;
+    uint8_t *buf;  // To encode into, or NULL to measure the chunks.
+    atomic_size_t next;  // Chunk to take next.
+} morse_pipeline_job;
+
+
+// --------------------------------------------------------------------
+
+
+static bool morse_pipeline_split(morse_pipeline *pipeline, size_t n);
+static void morse_pipeline_run(morse_pipeline *pipeline, uint8_t *buf);
+static void *morse_pipeline_worker(void *job);
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Prepare to encode the n characters of s, under policy, and
+ * measure them with a pool of threads.
+ *
+ * s is read again by morse_pipeline_encode(), so must outlive the
+ * pipeline, and need not be terminated. It is split only after spaces,
+ * so a text must have them at least every MORSE_PIPELINE_CHUNK bytes
+ * or so to be spread over all threads.
+ *
+ * \param threads Threads to use, including the caller, or 0 for one
+ *      per online CPU.
+ * \return Size in bytes of the encoded message, as morse_encoded_size(),
+ *      or zero if it cannot be encoded. The pipeline must be passed to
+ *      morse_pipeline_free() either way.
+ */
+uint32_t morse_pipeline_init(
+        morse_pipeline *pipeline,
+        const char *s,
+        const size_t n,
+        const morse_policy policy,
+        unsigned threads) {
+    if (!threads) {
+        const long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned) online : 1;
+    }
+    *pipeline = (morse_pipeline) {s, policy, threads, NULL, 0, 0, 0};
+    if (!morse_pipeline_split(pipeline, n)) return 0;
+    morse_pipeline_run(pipeline, NULL);
+    // Lay the chunks out end to end, each starting within a prosign if
+    // the last delimiter before it opened one.
+    uint64_t bit = 0;
+    uint64_t invalid = 0;
+    bool in_prosign = false;
+    for (size_t i = 0; i < pipeline->len && bit <= UINT32_MAX; ++i) {
+        morse_pipeline_chunk *const chunk = &pipeline->chunks[i];
+        const uint64_t bits = in_prosign
+                ? chunk->piece.prosign_bits : chunk->piece.bits;
+        chunk->bit = (uint32_t) bit;
+        chunk->bits = (uint32_t) bits;
+        chunk->in_prosign = in_prosign;
+        if (chunk->piece.delimited) in_prosign = chunk->piece.in_prosign;
+        bit += bits;
+        invalid += chunk->piece.invalid;
+    }
+    if (policy == MORSE_POLICY_ERROR && invalid) {
+        fprintf(stderr, "Text has %llu chars without a pattern.",
+                (unsigned long long) invalid);
+        return 0;
+    }
+    if (bit > UINT32_MAX) {
+        fprintf(stderr, "Buffer size limit reached.");
+        return 0;
+    }
+    pipeline->bits = (uint32_t) bit;
+    pipeline->size = morse_piece_finish(NULL, pipeline->bits, UINT32_MAX);
+    return pipeline->size;
+}
+
+/**
+ * \brief Encode the text of a pipeline into buf with its pool of
+ * threads, as morse_encode() would the whole text.
+ *
+ * \param size Size of buf in bytes, at least that returned by
+ *      morse_pipeline_init().
+ * \return Size of the encoded message in bytes, or zero if it was not
+ *      encoded, in which case the length in buf is zero.
+ */
+uint32_t morse_pipeline_encode(
+        morse_pipeline *pipeline, uint8_t *buf, const uint32_t size) {
+    if (!pipeline->size) {
+        if (size >= 4) memset(buf, 0, 4);
+        return 0;
+    }
+    // A buffer too small is reported and cleared as such.
+    if (size < pipeline->size) {
+        return morse_piece_finish(buf, pipeline->bits, size);
+    }
+    morse_pipeline_run(pipeline, buf);
+    // Each byte shared by two chunks was left to the caller, as were
+    // the end of the last one and the padding after it.
+    const uint32_t end = pipeline->bits;
+    for (size_t i = 0; i < pipeline->len; ++i) {
+        const uint32_t bit = pipeline->chunks[i].bit;
+        if (bit % 8) buf[4 + bit / 8] = 0;
+    }
+    if (end % 8) buf[4 + end / 8] = 0;
+    for (size_t i = 0; i < pipeline->len; ++i) {
+        const morse_pipeline_chunk *const chunk = &pipeline->chunks[i];
+        const uint32_t chunk_end = chunk->bit + chunk->bits;
+        if (chunk->bit % 8) buf[4 + chunk->bit / 8] |= chunk->edges[0];
+        if (chunk_end % 8) buf[4 + chunk_end / 8] |= chunk->edges[1];
+    }
+    return morse_piece_finish(buf, end, size);
+}
+
+/**
+ * \brief Free the chunks of a pipeline.
+ */
+void morse_pipeline_free(morse_pipeline *pipeline) {
+    free(pipeline->chunks);
+    pipeline->chunks = NULL;
+    pipeline->len = 0;
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Split the n characters of the text of a pipeline into
+ * chunks, of MORSE_PIPELINE_CHUNK bytes or more, each ending after a
+ * space, other than the last.
+ */
+static bool morse_pipeline_split(morse_pipeline *pipeline, const size_t n) {
+    size_t target = n / ((size_t) pipeline->threads * MORSE_PIPELINE_SPLIT);
+    if (target < MORSE_PIPELINE_CHUNK) target = MORSE_PIPELINE_CHUNK;
+    if (!target) target = 1;
+    const size_t cap = n / target + 1;
+    pipeline->chunks = malloc(cap * sizeof(*pipeline->chunks));
+    if (!pipeline->chunks) {
+        fprintf(stderr, "Failed to allocate %zu chunks.", cap);
+        return false;
+    }
+    const char *const s = pipeline->s;
+    for (size_t start = 0; start < n;) {
+        size_t end = n;
+        if (n - start > target) {
+            const char *const space = memchr(
+                    s + start + target - 1, ' ', n - start - target + 1);
+            if (space) end = (size_t) (space - s) + 1;
+        }
+        morse_pipeline_chunk *const chunk =
+                &pipeline->chunks[pipeline->len++];
+        chunk->start = start;
+        chunk->n = end - start;
+        start = end;
+    }
+    return true;
+}
+
+/**
+ * \brief Measure, or if buf is set encode, every chunk of a pipeline,
+ * using its threads.
+ *
+ * The caller takes chunks as well, so all are done even if no thread
+ * can be started.
+ */
+static void morse_pipeline_run(morse_pipeline *pipeline, uint8_t *buf) {
+    morse_pipeline_job job = {pipeline, buf, 0};
+    // No more threads than chunks, counting the caller.
+    size_t wanted = pipeline->threads - 1;
+    if (pipeline->len <= wanted) {
+        wanted = pipeline->len ? pipeline->len - 1 : 0;
+    }
+    pthread_t *const ids = wanted ? malloc(wanted * sizeof(*ids)) : NULL;
+    size_t started = 0;
+    while (ids && started < wanted && !pthread_create(
+            &ids[started], NULL, morse_pipeline_worker, &job)) {
+        ++started;
+    }
+    morse_pipeline_worker(&job);
+    for (size_t i = 0; i < started; ++i) pthread_join(ids[i], NULL);
+    free(ids);
+}
+
+/**
+ * \brief Take chunks of a job until none are left.
+ */
+static void *morse_pipeline_worker(void *arg) {
+    morse_pipeline_job *const job = arg;
+    morse_pipeline *const pipeline = job->pipeline;
+    for (;;) {
+        const size_t i =
+                atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed);
+        if (i >= pipeline->len) return NULL;
+        morse_pipeline_chunk *const chunk = &pipeline->chunks[i];
+        const char *const s = pipeline->s + chunk->start;
+        if (job->buf) {
+            morse_piece_encode(
+                    job->buf, chunk->bit, s, chunk->n, pipeline->policy,
+                    chunk->in_prosign, chunk->edges);
+        } else {
+            morse_piece_measure(&chunk->piece, s, chunk->n, pipeline->policy);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef MORSE_PIPELINE_H_
+#define MORSE_PIPELINE_H_
+
+#include "morse.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifndef MORSE_PIPELINE_CHUNK
+  #define MORSE_PIPELINE_CHUNK (1 << 20)  // Least bytes of text per chunk.
+#endif  // MORSE_PIPELINE_CHUNK
+
+#ifndef MORSE_PIPELINE_SPLIT
+  #define MORSE_PIPELINE_SPLIT 4  // Chunks per thread, to balance them.
+#endif  // MORSE_PIPELINE_SPLIT
+
+
+/**
+ * \brief Chunk of the text of a morse_pipeline, ending after a space.
+ */
+typedef struct {
+    size_t start;  // Offset in the text.
+    size_t n;
+    morse_piece piece;
+    uint32_t bit;  // Bit index at which the chunk is encoded.
+    uint32_t bits;  // Encoded length.
+    bool in_prosign;  // Whether the chunk starts within a prosign.
+    uint8_t edges[2];  // Bits shared with the chunks either side.
+} morse_pipeline_chunk;
+
+/**
+ * \brief Encoder of one long text, such as a corpus, into a single
+ * message of MORSE_FORMAT_BITS using a pool of threads.
+ *
+ * The text is split into chunks after spaces, which are measured at
+ * once by morse_pipeline_init(). As the encoded length of each chunk
+ * then only depends on whether it starts within a prosign, which the
+ * chunks before it decide, the bit index of every chunk is known
+ * before any is encoded. morse_pipeline_encode() then has each thread
+ * write its chunks straight into the one output buffer, other than the
+ * bytes shared by two chunks, which are or'd together once all are
+ * written. Needs a POSIX host with threads. Fields should be treated
+ * as private.
+ */
+typedef struct {
+    const char *s;
+    morse_policy policy;
+    unsigned threads;
+    morse_pipeline_chunk *chunks;
+    size_t len;  // Chunks in use.
+    uint32_t bits;  // Encoded length of the text, without padding.
+    uint32_t size;  // Of the encoded message in bytes.
+} morse_pipeline;
+
+
+uint32_t morse_pipeline_init(
+        morse_pipeline *pipeline,
+        const char *s,
+        size_t n,
+        morse_policy policy,
+        unsigned threads);
+uint32_t morse_pipeline_encode(
+        morse_pipeline *pipeline, uint8_t *buf, uint32_t size);
+void morse_pipeline_free(morse_pipeline *pipeline);
+
+
+#endif  // MORSE_PIPELINE_H_
@@ -0,0 +1,124 @@
+#include "morse_render.h"
+
+#include "morse.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// --------------------------------------------------------------------
+
+
+static uint64_t morse_render_sample(
+        const morse_renderer *renderer, uint32_t dot);
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Prepare a renderer to play an encoded message.
+ *
+ * Samples are 1 while the signal is on and 0 while it is off, until
+ * on and off are set to the words expected by the peripheral. Dot
+ * durations need not be a whole number of samples: each edge is
+ * placed on the first sample at or after its exact time, so timing
+ * does not drift over long messages.
+ *
+ * \param buf Message encoded by morse_encode(), which must remain
+ *      unchanged while it is rendered.
+ * \param sample_rate_hz Rate at which DMA copies samples.
+ * \param dot_duration_ms Length of one dot duration in ms, by which
+ *      every element and gap of the message is timed.
+ */
+void morse_render_init(
+        morse_renderer *renderer,
+        const uint8_t *buf,
+        uint32_t sample_rate_hz,
+        uint32_t dot_duration_ms) {
+    *renderer = (morse_renderer) {
+        .buf = buf,
+        .len = morse_len(buf),
+        .scale = (uint64_t) sample_rate_hz * dot_duration_ms,
+        .on = 1,
+        .off = 0,
+    };
+}
+
+/**
+ * \brief Render the next samples of the message.
+ *
+ * Works a run of samples at a time, rather than a dot duration or
+ * sample at a time, so the cost is mostly that of storing the
+ * samples. If the renderer repeats, the message starts again once it
+ * is complete.
+ *
+ * \param samples Buffer to write up to n samples to.
+ * \return Number of samples written. Less than n only once the
+ *      message is complete.
+ */
+size_t morse_render(morse_renderer *renderer, uint32_t *samples, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if (renderer->pos == renderer->run_end) {
+            if (renderer->edge >= renderer->len) {
+                if (!renderer->repeat || !renderer->len) break;
+                renderer->pos = 0;
+                renderer->edge = 0;
+            }
+            // Runs shorter than a sample may have no samples at all,
+            // so loop again rather than fill.
+            renderer->value = morse_bit(renderer->buf, renderer->edge);
+            renderer->edge =
+                    morse_edge(renderer->buf, renderer->edge, renderer->len);
+            renderer->run_end = morse_render_sample(renderer, renderer->edge);
+            continue;
+        }
+        const uint32_t word = renderer->value ? renderer->on : renderer->off;
+        const uint64_t left = renderer->run_end - renderer->pos;
+        const size_t end = left < n - i ? i + (size_t) left : n;
+        renderer->pos += end - i;
+        for (; i < end; ++i) samples[i] = word;
+    }
+    return i;
+}
+
+/**
+ * \brief Refill one half of a double buffer played by DMA in circular
+ * mode.
+ *
+ * Call with second_half false from the half transfer interrupt, and
+ * true from the transfer complete interrupt, so that each half is
+ * refilled while the other plays. Once the message is complete, the
+ * rest of the half is filled with off samples.
+ *
+ * \param samples Buffer of 2 * n samples played by DMA.
+ * \param n Number of samples in each half of the buffer.
+ * \return Whether any of the message was written. Once false, DMA may
+ *      be stopped at the next interrupt.
+ */
+bool morse_render_refill(
+        morse_renderer *renderer,
+        uint32_t *samples,
+        size_t n,
+        bool second_half) {
+    uint32_t *const half = second_half ? samples + n : samples;
+    size_t i = morse_render(renderer, half, n);
+    const bool rendered = i != 0;
+    for (; i < n; ++i) half[i] = renderer->off;
+    return rendered;
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Get index of the first sample at or after the start of dot
+ * duration dot.
+ */
+static uint64_t morse_render_sample(
+        const morse_renderer *renderer, uint32_t dot) {
+    return (dot * renderer->scale + 999) / 1000;
+}
@@ -0,0 +1,52 @@
+#ifndef MORSE_RENDER_H_
+#define MORSE_RENDER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct morse_renderer morse_renderer;
+
+/**
+ * \brief State of a renderer turning an encoded message into samples
+ * for hardware to play.
+ *
+ * Each sample is a word for DMA to copy to a peripheral at a fixed
+ * sample rate, such as a timer compare value to key a PWM output, or
+ * a GPIO set/reset word to key a pin. Once a buffer of samples is
+ * handed to DMA, the message plays without the CPU, other than to
+ * refill the buffer with morse_render_refill() at each half or full
+ * transfer interrupt.
+ *
+ * Fields should be treated as private, other than on, off and repeat,
+ * which may be set after morse_render_init().
+ */
+struct morse_renderer {
+    const uint8_t *buf;  // Message encoded by morse_encode().
+    uint32_t len;  // Length of buf in dot durations.
+    uint64_t scale;  // Samples per 1000 dot durations.
+    uint64_t pos;  // Samples rendered since the message started.
+    uint64_t run_end;  // Sample at which the current run ends.
+    uint32_t edge;  // Dot duration at which the current run ends.
+    bool value;  // Signal of the current run.
+    bool repeat;
+    uint32_t on;  // Sample written while the signal is on.
+    uint32_t off;  // Sample written while the signal is off.
+};
+
+
+void morse_render_init(
+        morse_renderer *renderer,
+        const uint8_t *buf,
+        uint32_t sample_rate_hz,
+        uint32_t dot_duration_ms);
+size_t morse_render(morse_renderer *renderer, uint32_t *samples, size_t n);
+bool morse_render_refill(
+        morse_renderer *renderer,
+        uint32_t *samples,
+        size_t n,
+        bool second_half);
+
+
+#endif  // MORSE_RENDER_H_
@@ -0,0 +1,328 @@
+#include "morse_sched.h"
+
+#include "morse.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if MORSE_STDIO
+  #include <stdio.h>
+  #define MORSE_REPORT(...) fprintf(stderr, __VA_ARGS__)
+#else
+  #define MORSE_REPORT(...) ((void) 0)
+#endif  // MORSE_STDIO
+
+
+// --------------------------------------------------------------------
+
+
+#define MORSE_SCHED_IDLE UINT16_MAX  // Slot of a channel off the wheel.
+#define MORSE_SCHED_NONE UINT16_MAX  // End of the channels of a slot.
+#define MORSE_SCHED_MASK (MORSE_SCHED_WHEEL - 1)
+
+
+// --------------------------------------------------------------------
+
+
+static void morse_sched_take_wakes(morse_sched *sched);
+static void morse_sched_run(
+        morse_sched *sched, uint16_t id, uint32_t start, uint32_t end);
+static void morse_sched_reschedule(morse_sched *sched, uint16_t id);
+static bool morse_sched_before(uint32_t a, uint32_t b);
+static uint32_t morse_sched_occupied(
+        const morse_sched *sched, uint32_t base, uint32_t from, uint32_t n);
+static unsigned morse_sched_ctz(uint32_t x);
+static void morse_sched_link(
+        morse_sched *sched, uint16_t id, uint32_t deadline);
+static void morse_sched_unlink(morse_sched *sched, uint16_t id);
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Prepare a scheduler with no channels, at time 0.
+ */
+void morse_sched_init(morse_sched *sched) {
+    for (size_t i = 0; i < MORSE_SCHED_WHEEL; ++i) {
+        sched->slots[i] = MORSE_SCHED_NONE;
+    }
+    for (size_t i = 0; i < MORSE_SCHED_WHEEL / 32; ++i) {
+        sched->occupied[i] = 0;
+    }
+    sched->len = 0;
+    sched->playing = 0;
+    sched->now = 0;
+    atomic_init(&sched->wake_seq, 0);
+    sched->wake_ack = 0;
+}
+
+/**
+ * \brief Add a context as the next channel of a scheduler.
+ *
+ * Channels are numbered from 0 in the order they are added. The
+ * context may already be playing, and is updated from now on only by
+ * the scheduler.
+ *
+ * \return false if the scheduler already has MORSE_SCHED_LEN channels.
+ */
+bool morse_sched_add(morse_sched *sched, morse_ctx *ctx) {
+    if (sched->len == MORSE_SCHED_LEN) {
+        MORSE_REPORT("Scheduler channel limit reached.");
+        return false;
+    }
+    const uint16_t id = sched->len++;
+    morse_sched_channel *const channel = &sched->channels[id];
+    channel->ctx = ctx;
+    channel->synced = sched->now;
+    channel->slot = MORSE_SCHED_IDLE;
+    atomic_init(&channel->woken, false);
+    morse_sched_reschedule(sched, id);
+    return true;
+}
+
+/**
+ * \brief Have the scheduler look at a channel again on its next
+ * update, after a call that may have brought its next edge forward,
+ * such as morse_ctx_send(), morse_ctx_enqueue(), morse_ctx_stream(),
+ * morse_ctx_interrupt() or morse_ctx_stop().
+ *
+ * May be called by the producer of any channel, from any thread.
+ * Wakes are found by a pass over all channels, on the first update
+ * after any of them, so it is cheap only while they are rare next to
+ * the updates.
+ */
+void morse_sched_wake(morse_sched *sched, const size_t channel) {
+    atomic_store_explicit(
+            &sched->channels[channel].woken, true, memory_order_release);
+    atomic_fetch_add_explicit(&sched->wake_seq, 1, memory_order_release);
+}
+
+/**
+ * \brief Advance all channels of a scheduler by the same elapsed time.
+ *
+ * Equivalent to calling morse_update_all() on every channel, other
+ * than that the contexts with no edge in the elapsed time are not
+ * touched. So channels should report their signal through edge_cb,
+ * as cb is only called when a channel is updated. Edges are reported
+ * at their offset from the start of the elapsed time, as by
+ * morse_ctx_update(). A channel woken since the last update takes
+ * what it was woken for at the start of the elapsed time, rather than
+ * at its end, as if updated by 0 ms straight after it was woken.
+ *
+ * \param elapsed_ms time since last update was called.
+ */
+void morse_sched_update(morse_sched *sched, const uint32_t elapsed_ms) {
+    morse_sched_take_wakes(sched);
+    const uint32_t start = sched->now;
+    const uint32_t end = start + elapsed_ms;
+    // Visit the slot of each ms from start to end, and each slot only
+    // once if that turns the wheel more than once.
+    const uint32_t n = elapsed_ms < MORSE_SCHED_WHEEL
+            ? elapsed_ms + 1 : MORSE_SCHED_WHEEL;
+    for (uint32_t i = morse_sched_occupied(sched, start, 0, n); i < n;
+            i = morse_sched_occupied(sched, start, i + 1, n)) {
+        uint16_t id = sched->slots[(start + i) & MORSE_SCHED_MASK];
+        while (id != MORSE_SCHED_NONE) {
+            // A channel moved back to the front of this slot is not met
+            // again, as it is due after end.
+            const uint16_t next = sched->channels[id].next;
+            if (!morse_sched_before(end, sched->channels[id].deadline)) {
+                morse_sched_run(sched, id, start, end);
+            }
+            id = next;
+        }
+    }
+    sched->now = end;
+}
+
+/**
+ * \brief Get time remaining until the signal of any channel of a
+ * scheduler next changes.
+ *
+ * Like morse_ctx_next_edge(), allows the caller to sleep for exactly
+ * the returned time, and then pass it to morse_sched_update(). A wake
+ * since the last update returns 0.
+ *
+ * \return ms until the next edge, or MORSE_NO_EDGE if no channel is
+ *      playing.
+ */
+uint32_t morse_sched_next_edge(const morse_sched *sched) {
+    if (atomic_load_explicit(&sched->wake_seq, memory_order_relaxed)
+            != sched->wake_ack) {
+        return 0;
+    }
+    // An edge is at least as far ahead as its slot, so slots are
+    // searched in order only until past the nearest edge found.
+    const uint32_t now = sched->now;
+    uint32_t best = MORSE_NO_EDGE;
+    for (uint32_t i = morse_sched_occupied(sched, now, 0, MORSE_SCHED_WHEEL);
+            i < MORSE_SCHED_WHEEL && i < best;
+            i = morse_sched_occupied(sched, now, i + 1, MORSE_SCHED_WHEEL)) {
+        uint16_t id = sched->slots[(now + i) & MORSE_SCHED_MASK];
+        for (; id != MORSE_SCHED_NONE; id = sched->channels[id].next) {
+            const uint32_t deadline = sched->channels[id].deadline;
+            if (!morse_sched_before(now, deadline)) return 0;
+            if (deadline - now < best) best = deadline - now;
+        }
+    }
+    return best;
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Reschedule each channel woken since the last update.
+ */
+static void morse_sched_take_wakes(morse_sched *sched) {
+    const uint32_t seq =
+            atomic_load_explicit(&sched->wake_seq, memory_order_acquire);
+    if (seq == sched->wake_ack) return;
+    sched->wake_ack = seq;
+    for (uint16_t id = 0; id < sched->len; ++id) {
+        morse_sched_channel *const channel = &sched->channels[id];
+        if (!atomic_load_explicit(&channel->woken, memory_order_relaxed)) {
+            continue;
+        }
+        atomic_exchange_explicit(
+                &channel->woken, false, memory_order_acquire);
+        // Take what the channel was woken for now, at the start of the
+        // elapsed time, while catching it up.
+        if (channel->slot == MORSE_SCHED_IDLE) channel->synced = sched->now;
+        morse_ctx_update(channel->ctx, sched->now - channel->synced);
+        channel->synced = sched->now;
+        morse_sched_reschedule(sched, id);
+    }
+}
+
+/**
+ * \brief Update a channel with an edge due by end, and move it to the
+ * slot of its next edge.
+ */
+static void morse_sched_run(
+        morse_sched *sched,
+        const uint16_t id,
+        const uint32_t start,
+        const uint32_t end) {
+    morse_sched_channel *const channel = &sched->channels[id];
+    // Bring the context up to start, which crosses no edge, so that
+    // the edges to end are reported at their offset from start.
+    if (morse_sched_before(channel->synced, start)) {
+        morse_ctx_update(channel->ctx, start - channel->synced);
+        channel->synced = start;
+    }
+    morse_ctx_update(channel->ctx, end - channel->synced);
+    channel->synced = end;
+    morse_sched_reschedule(sched, id);
+}
+
+/**
+ * \brief Work out the deadline of a channel from its context, and
+ * move it to the slot for it, or off the wheel if it has none.
+ */
+static void morse_sched_reschedule(morse_sched *sched, const uint16_t id) {
+    morse_sched_channel *const channel = &sched->channels[id];
+    // A context with nothing to play does not keep time, so one
+    // coming back on the wheel is caught up to now.
+    if (channel->slot == MORSE_SCHED_IDLE) {
+        channel->synced = sched->now;
+    } else {
+        morse_sched_unlink(sched, id);
+    }
+    const uint32_t next = morse_ctx_next_edge(channel->ctx);
+    if (next != MORSE_NO_EDGE) {
+        morse_sched_link(sched, id, channel->synced + next);
+    }
+}
+
+/**
+ * \brief Whether scheduler time a is before b, allowing for wrapping.
+ */
+static bool morse_sched_before(const uint32_t a, const uint32_t b) {
+    return (int32_t) (a - b) < 0;
+}
+
+/**
+ * \brief Find the first non-empty slot of the n slots from base,
+ * starting from slots after base.
+ *
+ * \return Slots after base of the non-empty slot, or n if none is.
+ */
+static uint32_t morse_sched_occupied(
+        const morse_sched *sched,
+        const uint32_t base,
+        uint32_t from,
+        const uint32_t n) {
+    while (from < n) {
+        const uint32_t slot = (base + from) & MORSE_SCHED_MASK;
+        // Bits for the rest of the word holding slot, which do not
+        // wrap, as the wheel is a whole number of words.
+        const uint32_t word = sched->occupied[slot / 32] >> (slot % 32);
+        if (word) {
+            from += morse_sched_ctz(word);
+            return from < n ? from : n;
+        }
+        from += 32 - slot % 32;
+    }
+    return n;
+}
+
+/**
+ * \brief Count trailing zero bits of x, which is not 0.
+ */
+static unsigned morse_sched_ctz(uint32_t x) {
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctz(x);
+#else
+    unsigned n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif  // __GNUC__
+}
+
+/**
+ * \brief Put a channel at the front of the slot of deadline.
+ */
+static void morse_sched_link(
+        morse_sched *sched, const uint16_t id, const uint32_t deadline) {
+    morse_sched_channel *const channel = &sched->channels[id];
+    const uint16_t slot = deadline & MORSE_SCHED_MASK;
+    channel->deadline = deadline;
+    channel->slot = slot;
+    channel->prev = MORSE_SCHED_NONE;
+    channel->next = sched->slots[slot];
+    if (channel->next != MORSE_SCHED_NONE) {
+        sched->channels[channel->next].prev = id;
+    }
+    sched->slots[slot] = id;
+    sched->occupied[slot / 32] |= (uint32_t) 1 << (slot % 32);
+    ++sched->playing;
+}
+
+/**
+ * \brief Take a channel off the wheel.
+ */
+static void morse_sched_unlink(morse_sched *sched, const uint16_t id) {
+    morse_sched_channel *const channel = &sched->channels[id];
+    const uint16_t slot = channel->slot;
+    if (channel->prev != MORSE_SCHED_NONE) {
+        sched->channels[channel->prev].next = channel->next;
+    } else {
+        sched->slots[slot] = channel->next;
+        if (channel->next == MORSE_SCHED_NONE) {
+            sched->occupied[slot / 32] &= ~((uint32_t) 1 << (slot % 32));
+        }
+    }
+    if (channel->next != MORSE_SCHED_NONE) {
+        sched->channels[channel->next].prev = channel->prev;
+    }
+    channel->slot = MORSE_SCHED_IDLE;
+    --sched->playing;
+}
@@ -0,0 +1,74 @@
+#ifndef MORSE_SCHED_H_
+#define MORSE_SCHED_H_
+
+#include "morse.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifndef MORSE_SCHED_LEN
+  #define MORSE_SCHED_LEN 256  // Channels per scheduler, below 65535.
+#endif  // MORSE_SCHED_LEN
+
+#ifndef MORSE_SCHED_WHEEL
+  // Slots of the timer wheel, one per ms. Must be a power of two, and
+  // a multiple of 32. Edges further ahead are kept, but passed over
+  // each turn of the wheel until due.
+  #define MORSE_SCHED_WHEEL 1024
+#endif  // MORSE_SCHED_WHEEL
+
+
+typedef struct morse_sched morse_sched;
+
+/**
+ * \brief Context driven by a morse_sched.
+ */
+typedef struct {
+    morse_ctx *ctx;
+    uint32_t synced;  // Scheduler time ctx was last updated to.
+    uint32_t deadline;  // Scheduler time of the next edge of ctx.
+    uint16_t slot;  // Of the wheel holding the channel, or MORSE_SCHED_IDLE.
+    uint16_t prev;  // Channels in the same slot, or MORSE_SCHED_NONE.
+    uint16_t next;
+    MORSE_ATOMIC(bool) woken;  // Set by morse_sched_wake().
+} morse_sched_channel;
+
+/**
+ * \brief Scheduler of many contexts on one clock, which only updates
+ * the contexts that have an edge due.
+ *
+ * Each playing channel is listed in the slot of a timer wheel for the
+ * ms of its next edge, so that an update only visits the slots for the
+ * elapsed time, skipping empty ones a word of a bitmap at a time, and
+ * the channels listed in them. Moving a channel to its next slot takes
+ * constant time. Channels with nothing to play are left off the wheel
+ * until woken.
+ *
+ * The scheduler is the consumer of each of its contexts: only it may
+ * call morse_ctx_update() and morse_ctx_next_edge() on them, and it
+ * may only be used from one thread. Producers call morse_sched_wake()
+ * after sending to, interrupting or stopping a channel, which they may
+ * do from other threads. Fields should be treated as private.
+ */
+struct morse_sched {
+    morse_sched_channel channels[MORSE_SCHED_LEN];
+    uint16_t slots[MORSE_SCHED_WHEEL];  // First channel of each slot.
+    uint32_t occupied[MORSE_SCHED_WHEEL / 32];  // Bit per non-empty slot.
+    uint16_t len;  // Channels added.
+    uint16_t playing;  // Channels on the wheel.
+    uint32_t now;  // ms since morse_sched_init(), wrapping.
+    MORSE_ATOMIC(uint32_t) wake_seq;  // Count of morse_sched_wake() calls.
+    uint32_t wake_ack;  // Count of wakes seen.
+};
+
+
+void morse_sched_init(morse_sched *sched);
+bool morse_sched_add(morse_sched *sched, morse_ctx *ctx);
+void morse_sched_wake(morse_sched *sched, size_t channel);
+void morse_sched_update(morse_sched *sched, uint32_t elapsed_ms);
+uint32_t morse_sched_next_edge(const morse_sched *sched);
+
+
+#endif  // MORSE_SCHED_H_
@@ -0,0 +1,222 @@
+#include "morse_tiny.h"
+
+#include "morse.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifndef MORSE_TINY_ROM
+  // Placement of the code table, such as PROGMEM on AVR, where const
+  // data is otherwise copied to RAM, along with MORSE_TINY_READ().
+  #define MORSE_TINY_ROM
+  #define MORSE_TINY_READ(p) (*(p))
+#endif  // MORSE_TINY_ROM
+
+
+// --------------------------------------------------------------------
+
+
+// Prosign states, as in morse.c.
+enum {
+    MORSE_TINY_JOIN_NONE,
+    MORSE_TINY_JOIN_FIRST,
+    MORSE_TINY_JOIN_NEXT,
+};
+
+// Elements of each character from ' ' to '_', a dot as 0 and a dash as
+// 1 from the lsb, below a 1 marking the end. A space is 1, with no
+// elements, and characters without a pattern are 0. Matches
+// MORSE_GLYPHS(), in a byte per character.
+static const uint8_t morse_tiny_codes[64] MORSE_TINY_ROM = {
+    0x01, 0x75, 0x52, 0x00, 0xC8, 0x00, 0x22, 0x5E,  //  !"#$%&'
+    0x2D, 0x6D, 0x00, 0x2A, 0x73, 0x61, 0x6A, 0x29,  // ()*+,-./
+    0x3F, 0x3E, 0x3C, 0x38, 0x30, 0x20, 0x21, 0x23,  // 01234567
+    0x27, 0x2F, 0x47, 0x55, 0x00, 0x31, 0x00, 0x4C,  // 89:;<=>?
+    0x56, 0x06, 0x11, 0x15, 0x09, 0x02, 0x14, 0x0B,  // @ABCDEFG
+    0x10, 0x04, 0x1E, 0x0D, 0x12, 0x07, 0x05, 0x0F,  // HIJKLMNO
+    0x16, 0x1B, 0x0A, 0x08, 0x03, 0x0C, 0x18, 0x0E,  // PQRSTUVW
+    0x19, 0x1D, 0x13, 0x00, 0x00, 0x00, 0x00, 0x6C,  // XYZ[\]^_
+};
+
+
+// --------------------------------------------------------------------
+
+
+static uint8_t morse_tiny_code(char c);
+static void morse_tiny_next_run(morse_tiny *tiny);
+static uint32_t morse_tiny_gap(morse_tiny *tiny);
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Prepare a player with nothing to play, at about 10 wpm.
+ */
+void morse_tiny_init(morse_tiny *tiny) {
+    *tiny = (morse_tiny) {0};
+    tiny->timing = (morse_timing) {120, 120};
+}
+
+/**
+ * \brief Set a string to be played, as morse() does.
+ *
+ * It starts on the next update if nothing is playing, or else once the
+ * live message has finished its current play. A string sent before
+ * then takes its place.
+ *
+ * \return Whether s was set. False if it holds a character without a
+ *      pattern, which is checked before anything is played.
+ */
+bool morse_tiny_send(morse_tiny *tiny, const char *s, const bool repeat) {
+    for (const char *c = s; *c; ++c) {
+        if (*c != '<' && *c != '>' && !morse_tiny_code(*c)) return false;
+    }
+    if (tiny->s && !tiny->start) {
+        tiny->next = s;
+        tiny->repeat_next = repeat;
+        tiny->repeat = false;
+    } else {
+        tiny->s = s;
+        tiny->p = s;
+        tiny->repeat = repeat;
+        tiny->start = true;
+        tiny->join = MORSE_TINY_JOIN_NONE;
+        tiny->left_ms = 0;
+    }
+    return true;
+}
+
+/**
+ * \brief Stop the string playing after its current play.
+ *
+ * As morse_ctx_stop(), does not affect a string yet to start.
+ */
+void morse_tiny_stop(morse_tiny *tiny) {
+    if (!tiny->start) tiny->repeat = false;
+}
+
+/**
+ * \brief Advance the player, calling cb for each change of the signal
+ * since the last update.
+ *
+ * \param elapsed_ms time since last update was called.
+ */
+void morse_tiny_update(morse_tiny *tiny, uint32_t elapsed_ms) {
+    // A message sent while idle starts from now, as in morse_ctx.
+    if (tiny->start) {
+        tiny->start = false;
+        morse_tiny_next_run(tiny);
+        return;
+    }
+    while (tiny->s) {
+        if (elapsed_ms < tiny->left_ms) {
+            tiny->left_ms -= elapsed_ms;
+            return;
+        }
+        elapsed_ms -= tiny->left_ms;
+        morse_tiny_next_run(tiny);
+    }
+}
+
+/**
+ * \brief Get time remaining until the signal next changes, as
+ * morse_ctx_next_edge().
+ *
+ * \return ms until the next edge, or MORSE_NO_EDGE if nothing is
+ *      playing.
+ */
+uint32_t morse_tiny_next_edge(const morse_tiny *tiny) {
+    return tiny->s ? tiny->left_ms : MORSE_NO_EDGE;
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Get the elements of c, as in morse_tiny_codes.
+ */
+static uint8_t morse_tiny_code(char c) {
+    uint8_t i = (uint8_t) c;
+    if (i >= 'a' && i <= 'z') i -= 'a' - 'A';
+    if (i < ' ' || i > '_') return 0;
+    return MORSE_TINY_READ(&morse_tiny_codes[i - ' ']);
+}
+
+/**
+ * \brief Start the next run of the live message, or of the message
+ * after it once it has ended.
+ *
+ * Each run is timed as it starts: on runs and gaps of one dot
+ * duration by dot_ms, and longer gaps by gap_ms.
+ */
+static void morse_tiny_next_run(morse_tiny *tiny) {
+    if (!tiny->p) {
+        if (tiny->next) {
+            tiny->s = tiny->next;
+            tiny->repeat = tiny->repeat_next;
+            tiny->next = NULL;
+        } else if (!tiny->repeat) {
+            tiny->s = NULL;
+            return;
+        }
+        tiny->p = tiny->s;
+        tiny->join = MORSE_TINY_JOIN_NONE;
+    }
+    const bool level = tiny->ones;
+    uint32_t units = tiny->ones;
+    tiny->ones = 0;
+    if (!level) units = morse_tiny_gap(tiny);
+    tiny->left_ms = units * (level || units == 1
+            ? tiny->timing.dot_ms : tiny->timing.gap_ms);
+    if (level != tiny->level) {
+        tiny->level = level;
+        if (tiny->cb) tiny->cb(level);
+    }
+}
+
+/**
+ * \brief Take the characters of the live message up to its next
+ * element, carrying on into the next play or message at its end.
+ *
+ * \return Dot durations of the gap before the element, including the
+ *      padding at the end of each play, as in MORSE_FORMAT_BITS. The
+ *      element is left in ones, or p is set to NULL if there is none.
+ */
+static uint32_t morse_tiny_gap(morse_tiny *tiny) {
+    uint32_t units = 0;
+    for (;;) {
+        // Each element follows a gap of one dot duration.
+        if (tiny->code > 1) {
+            tiny->ones = tiny->code & 1 ? 3 : 1;
+            tiny->code >>= 1;
+            return units + 1;
+        }
+        const char c = *tiny->p;
+        if (!c) {
+            tiny->p = NULL;
+            return units + 16;
+        }
+        ++tiny->p;
+        if (c == '<' || c == '>') {
+            tiny->join = c == '<'
+                    ? MORSE_TINY_JOIN_FIRST : MORSE_TINY_JOIN_NONE;
+            continue;
+        }
+        const uint8_t code = morse_tiny_code(c);
+        if (code == 1) {
+            // A space within a prosign starts a new one after it.
+            units += 4;
+            if (tiny->join) tiny->join = MORSE_TINY_JOIN_FIRST;
+            continue;
+        }
+        // Characters start with 2 empty dot durations, other than
+        // those joined to the one before in a prosign.
+        if (tiny->join != MORSE_TINY_JOIN_NEXT) units += 2;
+        if (tiny->join) tiny->join = MORSE_TINY_JOIN_NEXT;
+        tiny->code = code;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef MORSE_TINY_H_
+#define MORSE_TINY_H_
+
+#include "morse.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+
+/**
+ * \brief Player of messages for MCUs with 1 or 2 KB of RAM, that plays
+ * the string it is sent in place, encoding a character at a time.
+ *
+ * Holds no buffer, so takes a few tens of bytes whatever the length of
+ * the message, and morse_tiny.c uses neither stdio nor the rest of the
+ * library, so links to a few hundred bytes. Plays the ASCII characters
+ * of MORSE_GLYPHS() other than the Latin-1 letters, and prosigns, as
+ * morse_ctx_send() does, at the same timing, but with a single caller
+ * rather than a producer and a consumer, and without a queue, stream,
+ * index or stats. The string must remain unchanged until it has been
+ * played. Fields should be treated as private, other than timing and
+ * cb, which may be set after morse_tiny_init().
+ */
+typedef struct {
+    const char *s;  // Live message, or NULL if none.
+    const char *p;  // Next character of s, or NULL after its last run.
+    const char *next;  // Message to play after s, or NULL.
+    uint32_t left_ms;  // Of the current run.
+    morse_timing timing;  // Of each run as it starts. Must not be 0.
+    uint8_t code;  // Elements of the live character still to play.
+    uint8_t ones;  // Dot durations of the element after the current gap.
+    uint8_t join;  // Prosign state, as for morse_ctx_send().
+    bool level;
+    bool start;  // Whether s is to start on the next update.
+    bool repeat;
+    bool repeat_next;
+    void (*cb)(bool value);  // Called as the signal changes.
+} morse_tiny;
+
+
+void morse_tiny_init(morse_tiny *tiny);
+bool morse_tiny_send(morse_tiny *tiny, const char *s, bool repeat);
+void morse_tiny_stop(morse_tiny *tiny);
+void morse_tiny_update(morse_tiny *tiny, uint32_t elapsed_ms);
+uint32_t morse_tiny_next_edge(const morse_tiny *tiny);
+
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif  // __cplusplus
+
+
+#endif  // MORSE_TINY_H_
@@ -0,0 +1,230 @@
+#include "morse_tone.h"
+
+#include "morse_render.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// --------------------------------------------------------------------
+
+
+// Samples synthesized per pass over each stage. Small enough for the
+// stages to stay in L1 cache, and large enough to amortize each pass.
+#define MORSE_TONE_BLOCK 64
+
+
+// --------------------------------------------------------------------
+
+
+static bool morse_tone_block(morse_tone *tone, float *block, size_t n);
+static bool morse_tone_shape(
+        morse_tone *tone, const uint32_t *key, float *block, size_t n);
+static void morse_tone_mix_s16(
+        const float *block, int16_t *samples, size_t n);
+static bool morse_tone_active(const morse_tone *tone);
+static float morse_tone_sin(float x);
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Prepare a synthesizer to play an encoded message.
+ *
+ * \param buf Message encoded by morse_encode(), which must remain
+ *      unchanged while it is played.
+ * \param sample_rate_hz Audio sample rate.
+ * \param dot_duration_ms Length of one dot duration in ms, which sets
+ *      the speed the message is keyed at.
+ * \param tone_hz Frequency of the tone, below sample_rate_hz / 2.
+ * \param ramp_ms Rise and fall time of each element. Around 5 ms
+ *      removes key clicks. Zero keys the tone abruptly.
+ */
+void morse_tone_init(
+        morse_tone *tone,
+        const uint8_t *buf,
+        uint32_t sample_rate_hz,
+        uint32_t dot_duration_ms,
+        uint32_t tone_hz,
+        uint32_t ramp_ms) {
+    morse_render_init(&tone->key, buf, sample_rate_hz, dot_duration_ms);
+    const uint32_t ramp_samples = sample_rate_hz * ramp_ms / 1000;
+    tone->phase = 0;
+    tone->phase_step =
+            (uint32_t) (((uint64_t) tone_hz << 32) / sample_rate_hz);
+    tone->ramp = 0;
+    tone->ramp_step = ramp_samples ? 1.0f / ramp_samples : 1.0f;
+    tone->amplitude = 1.0f;
+}
+
+/**
+ * \brief Synthesize the next samples of the message as floats, and
+ * add them to samples.
+ *
+ * Samples are added rather than stored, so that many channels can be
+ * mixed into one buffer. Clear the buffer first to play only one.
+ *
+ * \return Whether the tone may still sound, false once the message is
+ *      complete and the last element has decayed.
+ */
+bool morse_tone_f32(morse_tone *tone, float *samples, size_t n) {
+    float block[MORSE_TONE_BLOCK];
+    bool active = false;
+    for (size_t i = 0; i < n; i += MORSE_TONE_BLOCK) {
+        const size_t m = n - i < MORSE_TONE_BLOCK ? n - i : MORSE_TONE_BLOCK;
+        if (!morse_tone_block(tone, block, m)) continue;
+        active = true;
+        for (size_t j = 0; j < m; ++j) samples[i + j] += block[j];
+    }
+    return active || morse_tone_active(tone);
+}
+
+/**
+ * \brief Synthesize the next samples of the message as 16 bit PCM,
+ * and add them to samples, saturating.
+ *
+ * See morse_tone_f32().
+ */
+bool morse_tone_s16(morse_tone *tone, int16_t *samples, size_t n) {
+    float block[MORSE_TONE_BLOCK];
+    bool active = false;
+    for (size_t i = 0; i < n; i += MORSE_TONE_BLOCK) {
+        const size_t m = n - i < MORSE_TONE_BLOCK ? n - i : MORSE_TONE_BLOCK;
+        if (!morse_tone_block(tone, block, m)) continue;
+        active = true;
+        morse_tone_mix_s16(block, samples + i, m);
+    }
+    return active || morse_tone_active(tone);
+}
+
+/**
+ * \brief Synthesize the tone as 16 bit PCM, keyed by the samples of key
+ * rather than by the message of the synthesizer, and add it to
+ * samples, saturating.
+ *
+ * Allows the tone to follow a signal from elsewhere, such as the
+ * edges of a context. The message passed to morse_tone_init() is not
+ * played, so may be empty.
+ *
+ * \param key n samples, each non-zero while the signal is on.
+ * \return Whether the tone may still sound, false once the key is off
+ *      and the last element has decayed.
+ */
+bool morse_tone_keyed_s16(
+        morse_tone *tone, const uint32_t *key, int16_t *samples, size_t n) {
+    float block[MORSE_TONE_BLOCK];
+    for (size_t i = 0; i < n; i += MORSE_TONE_BLOCK) {
+        const size_t m = n - i < MORSE_TONE_BLOCK ? n - i : MORSE_TONE_BLOCK;
+        if (!morse_tone_shape(tone, key + i, block, m)) continue;
+        morse_tone_mix_s16(block, samples + i, m);
+    }
+    return tone->ramp > 0 || (n && key[n - 1]);
+}
+
+
+// --------------------------------------------------------------------
+
+
+/**
+ * \brief Synthesize the next n (<= MORSE_TONE_BLOCK) samples into
+ * block.
+ *
+ * Keying, the ramp, and the oscillator are each worked out in a
+ * separate pass over the block. Only the ramp depends on the previous
+ * sample, so the other passes are free to be vectorized.
+ *
+ * \return Whether any sample is not silent. If not, block is left
+ *      unset.
+ */
+static bool morse_tone_block(morse_tone *tone, float *block, size_t n) {
+    uint32_t key[MORSE_TONE_BLOCK];
+    size_t i = morse_render(&tone->key, key, n);
+    for (; i < n; ++i) key[i] = 0;
+    return morse_tone_shape(tone, key, block, n);
+}
+
+/**
+ * \brief Synthesize n (<= MORSE_TONE_BLOCK) samples into block, keyed
+ * by the n samples of key.
+ *
+ * \return As morse_tone_block().
+ */
+static bool morse_tone_shape(
+        morse_tone *tone, const uint32_t *key, float *block, size_t n) {
+    size_t i;
+
+    // Skip silence without running the oscillator.
+    uint32_t any = 0;
+    for (i = 0; i < n; ++i) any |= key[i];
+    if (!any && tone->ramp <= 0) {
+        tone->phase += (uint32_t) n * tone->phase_step;
+        return false;
+    }
+
+    // Follow the key with a linear ramp...
+    float ramp = tone->ramp;
+    const float step = tone->ramp_step;
+    for (i = 0; i < n; ++i) {
+        ramp += key[i] ? step : -step;
+        ramp = ramp > 1.0f ? 1.0f : ramp;
+        ramp = ramp < 0.0f ? 0.0f : ramp;
+        block[i] = ramp;
+    }
+    tone->ramp = ramp;
+
+    // ...shaped into a raised cosine, sin^2(pi / 2 * ramp), which
+    // applies the tone's amplitude...
+    const float amplitude = tone->amplitude;
+    for (i = 0; i < n; ++i) {
+        const float s = morse_tone_sin(0.5f * block[i]);
+        block[i] = s * s * amplitude;
+    }
+
+    // ...to the oscillator.
+    const uint32_t phase = tone->phase;
+    const uint32_t phase_step = tone->phase_step;
+    for (i = 0; i < n; ++i) {
+        const int32_t p = (int32_t) (phase + (uint32_t) i * phase_step);
+        block[i] *= morse_tone_sin(p * (1.0f / 2147483648.0f));
+    }
+    tone->phase = phase + (uint32_t) n * phase_step;
+    return true;
+}
+
+/**
+ * \brief Add n synthesized samples to 16 bit PCM samples, saturating.
+ */
+static void morse_tone_mix_s16(
+        const float *block, int16_t *samples, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        float sample = samples[i] + block[i] * 32767.0f;
+        sample = sample > 32767.0f ? 32767.0f : sample;
+        sample = sample < -32768.0f ? -32768.0f : sample;
+        samples[i] = (int16_t) sample;
+    }
+}
+
+/**
+ * \brief Whether any of the message remains to be played, or its last
+ * element is still decaying.
+ */
+static bool morse_tone_active(const morse_tone *tone) {
+    const morse_renderer *const key = &tone->key;
+    return tone->ramp > 0 || key->pos != key->run_end ||
+            (key->len && (key->edge < key->len || key->repeat));
+}
+
+/**
+ * \brief Approximate sin(pi * x), for x in [-1, 1].
+ *
+ * A parabola corrected towards the sine, with an error below 0.001,
+ * and no branch or table, so that it vectorizes.
+ */
+static float morse_tone_sin(const float x) {
+    const float abs_x = x < 0 ? -x : x;
+    const float y = 4.0f * x * (1.0f - abs_x);
+    const float abs_y = y < 0 ? -y : y;
+    return y + 0.225f * (y * abs_y - y);
+}
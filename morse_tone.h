@@ -0,0 +1,48 @@
+#ifndef MORSE_TONE_H_
+#define MORSE_TONE_H_
+
+#include "morse_render.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct morse_tone morse_tone;
+
+/**
+ * \brief State of a synthesizer playing an encoded message as an
+ * audio tone.
+ *
+ * The tone is keyed by a morse_renderer at the audio sample rate, and
+ * each edge is shaped by a raised cosine ramp, so that keying does not
+ * click. Samples are produced a block at a time, in loops that the
+ * compiler can vectorize.
+ *
+ * Fields should be treated as private, other than amplitude and
+ * key.repeat, which may be set after morse_tone_init().
+ */
+struct morse_tone {
+    morse_renderer key;
+    uint32_t phase;  // Of the oscillator, a full cycle per 2^32.
+    uint32_t phase_step;  // Per sample.
+    float ramp;  // Position in keying ramp, from 0 (off) to 1 (on).
+    float ramp_step;  // Per sample.
+    float amplitude;  // Peak sample, 1 for full scale.
+};
+
+
+void morse_tone_init(
+        morse_tone *tone,
+        const uint8_t *buf,
+        uint32_t sample_rate_hz,
+        uint32_t dot_duration_ms,
+        uint32_t tone_hz,
+        uint32_t ramp_ms);
+bool morse_tone_f32(morse_tone *tone, float *samples, size_t n);
+bool morse_tone_s16(morse_tone *tone, int16_t *samples, size_t n);
+bool morse_tone_keyed_s16(
+        morse_tone *tone, const uint32_t *key, int16_t *samples, size_t n);
+
+
+#endif  // MORSE_TONE_H_